@@ -0,0 +1,170 @@
+#include "../include/databaseHandler.hpp"
+#include "../include/replyBuilder.hpp"
+#include "bench.hpp"
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <iomanip>
+#include <locale>
+#include <new>
+#include <sstream>
+
+// Every heap allocation made through operator new in this binary is counted.
+// SQLite allocates with malloc, so only our own row and reply building shows.
+std::atomic<long> heapAllocations{0};
+
+void *operator new(std::size_t size) {
+  heapAllocations.fetch_add(1, std::memory_order_relaxed);
+
+  if (void *pointer = std::malloc(size ? size : 1)) {
+    return pointer;
+  }
+
+  throw std::bad_alloc();
+}
+
+void operator delete(void *pointer) noexcept { std::free(pointer); }
+
+void operator delete(void *pointer, std::size_t) noexcept {
+  std::free(pointer);
+}
+
+namespace {
+
+const char *allocationDbPath = "allocation-bench.db";
+const int historyPageSize = 10;
+
+// One /history page the way the handler builds it: rows and field text in
+// the command's arena.
+size_t buildArenaPage(DatabaseHandler &dbHandler) {
+  ReplyArena arena;
+  std::pmr::vector<TransactionRecord> history = dbHandler.getUserHistoryPage(
+      "user", INT64_MAX, true, historyPageSize + 1, arena.get());
+
+  std::pmr::string value(arena.get());
+  size_t length = 0;
+
+  for (const TransactionRecord &record : history) {
+    double total = std::abs(record.value);
+    double price = total / record.quantity;
+
+    value.clear();
+    value += "Quantity: ";
+    appendInteger(value, record.quantity);
+    value += "\nPrice: $";
+    appendFixed(value, price, (price < 10.0) ? 4 : 2);
+    value += "\nTotal: $";
+    appendMoney(value, total);
+    value += " USD\nDate: ";
+    value += record.timestamp;
+    length += value.size();
+  }
+
+  return length;
+}
+
+// The same page built the way replies were before the arena: rows on the
+// heap and a locale-aware stream for every number.
+size_t buildStreamPage(DatabaseHandler &dbHandler) {
+  std::pmr::vector<TransactionRecord> history = dbHandler.getUserHistoryPage(
+      "user", INT64_MAX, true, historyPageSize + 1);
+
+  size_t length = 0;
+
+  for (const TransactionRecord &record : history) {
+    double total = std::abs(record.value);
+    double price = total / record.quantity;
+
+    std::ostringstream oss;
+    oss.imbue(std::locale(""));
+    oss << record.quantity;
+    std::string quantityString = oss.str();
+
+    oss.str("");
+    oss << std::fixed << std::setprecision(2) << total;
+    std::string totalString = oss.str();
+
+    oss.str("");
+    oss << std::fixed << std::setprecision((price < 10.0) ? 4 : 2) << price;
+    std::string priceString = oss.str();
+
+    std::ostringstream valueStream;
+    valueStream << "Quantity: " << quantityString << "\nPrice: $"
+                << priceString << "\nTotal: $" << totalString
+                << " USD\nDate: " << record.timestamp;
+    length += valueStream.str().size();
+  }
+
+  return length;
+}
+
+template <typename Build>
+void measurePages(DatabaseHandler &dbHandler, long pages, Build build,
+                  long &allocations, int64_t &nanos) {
+  long allocationsBefore = heapAllocations.load();
+  int64_t start = benchNanos();
+
+  for (long i = 0; i < pages; i++) {
+    build(dbHandler);
+  }
+
+  nanos = (benchNanos() - start) / std::max<long>(pages, 1);
+  allocations =
+      (heapAllocations.load() - allocationsBefore) / std::max<long>(pages, 1);
+}
+
+} // namespace
+
+// Counts the heap allocations and time of building one /history page, with
+// the per-command arena and the old way.
+int runAllocationBench(int argc, char *argv[]) {
+  long rows = benchArgument(argc, argv, 1, 1000);
+  long pages = benchArgument(argc, argv, 2, 2000);
+
+  std::pmr::string formatted;
+  appendMoney(formatted, 1234567.5);
+  BENCH_CHECK(formatted == "1,234,567.50");
+
+  std::remove(allocationDbPath);
+
+  {
+    DatabaseHandler dbHandler(allocationDbPath);
+    BENCH_CHECK(dbHandler.createTables());
+    BENCH_CHECK(dbHandler.beginTransaction());
+
+    for (long i = 0; i < rows; i++) {
+      BENCH_CHECK(dbHandler.updateTransactionsHistory(
+          "user", "AAPL", 1 + i % 100, (i % 2 ? 1.0 : -1.0) * (150.0 + i),
+          "2024-01-01 00:00:00"));
+    }
+
+    BENCH_CHECK(dbHandler.commitTransaction());
+
+    long arenaAllocations = 0;
+    long streamAllocations = 0;
+    int64_t arenaNanos = 0;
+    int64_t streamNanos = 0;
+
+    BENCH_CHECK(buildArenaPage(dbHandler) > 0);
+    measurePages(dbHandler, pages, buildArenaPage, arenaAllocations,
+                 arenaNanos);
+    measurePages(dbHandler, pages, buildStreamPage, streamAllocations,
+                 streamNanos);
+
+    // A page fits in the arena's inline storage.
+    BENCH_CHECK(arenaAllocations == 0);
+
+    std::cout << "History page of " << historyPageSize << " rows, " << pages
+              << " pages" << std::endl;
+    std::cout << "  arena: " << arenaAllocations << " allocations, "
+              << arenaNanos / 1000 << " us per page" << std::endl;
+    std::cout << "  streams: " << streamAllocations << " allocations, "
+              << streamNanos / 1000 << " us per page" << std::endl;
+  }
+
+  std::remove(allocationDbPath);
+  std::remove((std::string(allocationDbPath) + "-wal").c_str());
+  std::remove((std::string(allocationDbPath) + "-shm").c_str());
+
+  return 0;
+}
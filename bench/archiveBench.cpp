@@ -0,0 +1,133 @@
+#include "../include/databaseHandler.hpp"
+#include "bench.hpp"
+#include <cstdio>
+
+namespace {
+
+const char *archiveDbPath = "archive-bench.db";
+const char *archiveArchivePath = "archive-bench-archive.db";
+const int archivePageSize = 10;
+const int archiveBatchSize = 5000;
+
+void removeDatabases() {
+  for (const char *path : {archiveDbPath, archiveArchivePath}) {
+    std::remove(path);
+    std::remove((std::string(path) + "-wal").c_str());
+    std::remove((std::string(path) + "-shm").c_str());
+  }
+}
+
+// Walks the user's whole history a page at a time, from the newest page when
+// `older` is set and from the oldest otherwise, and returns the IDs in walking
+// order. Pages list newest first either way. Each page's time goes into the
+// hot or archive samples by where the row it ends on lives.
+std::vector<int64_t> walkHistory(DatabaseHandler &dbHandler, bool older,
+                                 int64_t lastArchivedId,
+                                 std::vector<int64_t> &hotSamples,
+                                 std::vector<int64_t> &archiveSamples) {
+  std::vector<int64_t> ids;
+  int64_t cursor = older ? INT64_MAX : 0;
+
+  while (true) {
+    int64_t start = benchNanos();
+    std::pmr::vector<TransactionRecord> page =
+        dbHandler.getUserHistoryPage("user", cursor, older, archivePageSize);
+    int64_t nanos = benchNanos() - start;
+
+    if (page.empty()) {
+      return ids;
+    }
+
+    if (older) {
+      for (const TransactionRecord &record : page) {
+        ids.push_back(record.transactionId);
+      }
+    } else {
+      for (auto it = page.rbegin(); it != page.rend(); ++it) {
+        ids.push_back(it->transactionId);
+      }
+    }
+
+    cursor = ids.back();
+    (cursor <= lastArchivedId ? archiveSamples : hotSamples).push_back(nanos);
+  }
+}
+
+} // namespace
+
+// Archives the older half of a ledger and pages through one user's history
+// in both directions. The pages must run from the hot ledger into the archive
+// (or back) without skipping, repeating or reordering a row.
+int runArchiveBench(int argc, char *argv[]) {
+  long rows = benchArgument(argc, argv, 1, 100000);
+
+  BENCH_CHECK(rows >= 4);
+
+  removeDatabases();
+
+  {
+    DatabaseHandler dbHandler(archiveDbPath);
+    BENCH_CHECK(dbHandler.createTables());
+    BENCH_CHECK(dbHandler.attachArchive(archiveArchivePath));
+    BENCH_CHECK(dbHandler.beginTransaction());
+
+    // Another user's trades in between, so the user's rows are not
+    // contiguous.
+    for (long i = 0; i < rows; i++) {
+      BENCH_CHECK(dbHandler.updateTransactionsHistory(
+          i % 2 ? "other" : "user", "AAPL", 1, -1.0, "2024-01-01 00:00:00"));
+    }
+
+    BENCH_CHECK(dbHandler.commitTransaction());
+
+    int64_t lastArchivedId = dbHandler.getLastTransactionId() / 2;
+    long archived = 0;
+    int64_t start = benchNanos();
+
+    while (true) {
+      int moved =
+          dbHandler.archiveTransactions(lastArchivedId, archiveBatchSize);
+      BENCH_CHECK(moved >= 0);
+
+      if (moved == 0) {
+        break;
+      }
+
+      archived += moved;
+    }
+
+    int64_t archiveNanos = benchNanos() - start;
+
+    BENCH_CHECK(archived == lastArchivedId);
+
+    std::vector<int64_t> hotSamples;
+    std::vector<int64_t> archiveSamples;
+    std::vector<int64_t> newestFirst = walkHistory(
+        dbHandler, true, lastArchivedId, hotSamples, archiveSamples);
+    std::vector<int64_t> oldestFirst = walkHistory(
+        dbHandler, false, lastArchivedId, hotSamples, archiveSamples);
+    size_t userRows = static_cast<size_t>((rows + 1) / 2);
+
+    BENCH_CHECK(newestFirst.size() == userRows);
+    BENCH_CHECK(std::is_sorted(newestFirst.rbegin(), newestFirst.rend()));
+    BENCH_CHECK(std::adjacent_find(newestFirst.begin(), newestFirst.end()) ==
+                newestFirst.end());
+    BENCH_CHECK(std::equal(oldestFirst.begin(), oldestFirst.end(),
+                           newestFirst.rbegin(), newestFirst.rend()));
+    BENCH_CHECK(newestFirst.back() <= lastArchivedId);
+    BENCH_CHECK(newestFirst.front() > lastArchivedId);
+
+    std::cout << "Ledger archive: " << archived << " of " << rows
+              << " rows archived in " << archiveNanos / 1000000 << " ms"
+              << std::endl;
+    std::cout << "  hot page: " << benchPercentile(hotSamples, 0.5) / 1000
+              << " us" << std::endl;
+    std::cout << "  archive page: "
+              << benchPercentile(archiveSamples, 0.5) / 1000 << " us"
+              << std::endl;
+  }
+
+  removeDatabases();
+
+  return 0;
+}
@@ -0,0 +1,148 @@
+#include "../include/costBasisBackfill.hpp"
+#include "bench.hpp"
+#include <cmath>
+#include <cstdio>
+#include <map>
+
+namespace {
+
+const char *backfillDbPath = "backfill-bench.db";
+
+void removeDatabase() {
+  std::remove(backfillDbPath);
+  std::remove((std::string(backfillDbPath) + "-wal").c_str());
+  std::remove((std::string(backfillDbPath) + "-shm").c_str());
+}
+
+using CostBasis = std::map<std::string, std::pair<double, double>>;
+
+CostBasis readCostBasis(DatabaseExecutor &dbExecutor) {
+  return dbExecutor
+      .submit([](DatabaseHandler &dbHandler) {
+        CostBasis costBasis;
+        sqlite3_stmt *stmt;
+
+        if (sqlite3_prepare_v2(dbHandler.getConnection(),
+                               "SELECT user_id, avg_cost, realized_pnl FROM "
+                               "user_stocks",
+                               -1, &stmt, nullptr) == SQLITE_OK) {
+          while (sqlite3_step(stmt) == SQLITE_ROW) {
+            costBasis[reinterpret_cast<const char *>(
+                sqlite3_column_text(stmt, 0))] = {
+                sqlite3_column_double(stmt, 1),
+                sqlite3_column_double(stmt, 2)};
+          }
+
+          sqlite3_finalize(stmt);
+        }
+
+        return costBasis;
+      })
+      .get();
+}
+
+bool matches(const CostBasis &actual, const CostBasis &expected) {
+  if (actual.size() != expected.size()) {
+    return false;
+  }
+
+  for (const auto &entry : expected) {
+    auto it = actual.find(entry.first);
+
+    if (it == actual.end() ||
+        std::abs(it->second.first - entry.second.first) > 1e-6 ||
+        std::abs(it->second.second - entry.second.second) > 1e-6) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Puts the database back where a bot from before the backfill would have
+// left it: the columns exist but hold nothing, and the version says so.
+bool resetCostBasis(DatabaseExecutor &dbExecutor) {
+  return dbExecutor
+      .submit([](DatabaseHandler &dbHandler) {
+        return sqlite3_exec(dbHandler.getConnection(),
+                            "UPDATE user_stocks SET avg_cost = 0, "
+                            "realized_pnl = 0",
+                            nullptr, nullptr, nullptr) == SQLITE_OK &&
+               dbHandler.setSchemaVersion(SCHEMA_VERSION_COST_BASIS);
+      })
+      .get();
+}
+
+} // namespace
+
+// Backfills the cost basis of a ledger traded through updateUserStock and
+// checks it against what the trades computed live. Running it again, as a
+// second process that read the old version would, or once the version is
+// set, must leave the same values.
+int runBackfillBench(int argc, char *argv[]) {
+  long users = benchArgument(argc, argv, 1, 1000);
+  long trades = benchArgument(argc, argv, 2, 100);
+
+  removeDatabase();
+
+  {
+    DatabaseHandler dbHandler(backfillDbPath);
+    BENCH_CHECK(dbHandler.createTables());
+    BENCH_CHECK(dbHandler.beginTransaction());
+
+    // Two shares bought for every one sold, at prices that move around, so
+    // both the average cost and the realized P&L depend on trade order.
+    for (long trade = 0; trade < trades; trade++) {
+      for (long user = 0; user < users; user++) {
+        std::string userId = "user" + std::to_string(user);
+        bool buying = trade % 2 == 0;
+        int quantity = buying ? 2 : 1;
+        double price = 100.0 + (trade * 7 + user) % 13;
+
+        BENCH_CHECK(dbHandler.updateUserStock(
+            userId, "AAPL", buying ? quantity : -quantity, price));
+        BENCH_CHECK(dbHandler.updateTransactionsHistory(
+            userId, "AAPL", quantity, (buying ? -1.0 : 1.0) * quantity * price,
+            "2024-01-01 00:00:00"));
+      }
+    }
+
+    BENCH_CHECK(dbHandler.commitTransaction());
+  }
+
+  {
+    DatabaseExecutor dbExecutor(backfillDbPath);
+    CostBasis expected = readCostBasis(dbExecutor);
+
+    BENCH_CHECK(expected.size() == static_cast<size_t>(users));
+    BENCH_CHECK(resetCostBasis(dbExecutor));
+
+    int64_t start = benchNanos();
+    BENCH_CHECK(backfillCostBasis(dbExecutor, backfillDbPath));
+    int64_t backfillNanos = benchNanos() - start;
+
+    BENCH_CHECK(matches(readCostBasis(dbExecutor), expected));
+
+    // Rerun over already backfilled values with the version rolled back.
+    BENCH_CHECK(dbExecutor
+                    .submit([](DatabaseHandler &dbHandler) {
+                      return dbHandler.setSchemaVersion(
+                          SCHEMA_VERSION_COST_BASIS);
+                    })
+                    .get());
+    BENCH_CHECK(backfillCostBasis(dbExecutor, backfillDbPath));
+    BENCH_CHECK(matches(readCostBasis(dbExecutor), expected));
+
+    // And once the version records the backfill, it is left alone.
+    BENCH_CHECK(backfillCostBasis(dbExecutor, backfillDbPath));
+    BENCH_CHECK(matches(readCostBasis(dbExecutor), expected));
+
+    std::cout << "Cost basis backfill: " << users << " users, " << trades
+              << " trades each, in " << backfillNanos / 1000000 << " ms"
+              << std::endl;
+  }
+
+  removeDatabase();
+
+  return 0;
+}
@@ -0,0 +1,116 @@
+#include "../include/backupJob.hpp"
+#include "bench.hpp"
+#include <cstdio>
+#include <filesystem>
+#include <future>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+const char *backupDbPath = "backup-bench.db";
+const char *backupDirectory = "backup-bench";
+
+void removeDatabase() {
+  std::remove(backupDbPath);
+  std::remove((std::string(backupDbPath) + "-wal").c_str());
+  std::remove((std::string(backupDbPath) + "-shm").c_str());
+  std::filesystem::remove_all(backupDirectory);
+}
+
+// Another bot process: commits a trade on its own connection every
+// millisecond until it is killed, which restarts any backup in progress.
+void runWriter() {
+  DatabaseHandler dbHandler(backupDbPath);
+
+  while (true) {
+    dbHandler.updateTransactionsHistory("writer", "AAPL", 1, -1.0,
+                                        "2024-01-01 00:00:00");
+    usleep(1000);
+  }
+}
+
+int64_t countRows(const std::string &path) {
+  DatabaseHandler dbHandler(path);
+  int64_t count = -1;
+  sqlite3_stmt *stmt;
+
+  if (sqlite3_prepare_v2(dbHandler.getConnection(),
+                         "SELECT COUNT(*) FROM user_transactions", -1, &stmt,
+                         nullptr) == SQLITE_OK) {
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+      count = sqlite3_column_int64(stmt, 0);
+    }
+
+    sqlite3_finalize(stmt);
+  }
+
+  return count;
+}
+
+} // namespace
+
+// Backs up a database while another process keeps writing to it. The copy
+// restarts on every foreign commit, so it only finishes because it switches
+// to a single step after BACKUP_MAX_RESTARTS of them.
+int runBackupBench(int argc, char *argv[]) {
+  long rows = benchArgument(argc, argv, 1, 200000);
+
+  removeDatabase();
+
+  {
+    DatabaseHandler dbHandler(backupDbPath);
+    BENCH_CHECK(dbHandler.createTables());
+    BENCH_CHECK(dbHandler.beginTransaction());
+
+    for (long i = 0; i < rows; i++) {
+      BENCH_CHECK(dbHandler.updateTransactionsHistory(
+          "user" + std::to_string(i % 100), "AAPL", 1, -1.0,
+          "2024-01-01 00:00:00"));
+    }
+
+    BENCH_CHECK(dbHandler.commitTransaction());
+  }
+
+  pid_t writer = fork();
+
+  if (writer == 0) {
+    runWriter();
+    _exit(0);
+  }
+
+  BENCH_CHECK(writer > 0);
+
+  BackupResult result;
+
+  {
+    DatabaseExecutor dbExecutor(backupDbPath);
+    BackupJob backupJob(dbExecutor, backupDirectory);
+    std::promise<BackupResult> done;
+    std::future<BackupResult> finished = done.get_future();
+
+    // Let the writer get going first.
+    usleep(100000);
+    BENCH_CHECK(backupJob.start(
+        [&done](const BackupResult &backup) { done.set_value(backup); }));
+
+    result = finished.get();
+  }
+
+  kill(writer, SIGKILL);
+  waitpid(writer, nullptr, 0);
+
+  BENCH_CHECK(result.success);
+  BENCH_CHECK(result.restarts >= BACKUP_MAX_RESTARTS);
+  BENCH_CHECK(countRows(result.path) >= rows);
+
+  std::cout << "Backup under foreign writes: " << rows << " rows in "
+            << result.durationMillis << " ms, " << result.steps << " steps, "
+            << result.restarts << " restarts, longest stall "
+            << result.maxStallMicros / 1000 << " ms" << std::endl;
+
+  removeDatabase();
+
+  return 0;
+}
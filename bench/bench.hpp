@@ -0,0 +1,60 @@
+#ifndef BENCH_HPP
+#define BENCH_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Every benchmark takes the arguments after its name and returns the process
+// exit code; a failed check prints why and returns 1.
+int runAllocationBench(int argc, char *argv[]);
+int runArchiveBench(int argc, char *argv[]);
+int runBackfillBench(int argc, char *argv[]);
+int runBackupBench(int argc, char *argv[]);
+int runChartBench(int argc, char *argv[]);
+int runLatencyBench(int argc, char *argv[]);
+int runOrderBookBench(int argc, char *argv[]);
+int runQuoteCacheBench(int argc, char *argv[]);
+int runShardBench(int argc, char *argv[]);
+int runSymbolDirectoryBench(int argc, char *argv[]);
+int runTickStoreBench(int argc, char *argv[]);
+int runUpstreamBench(int argc, char *argv[]);
+
+inline int64_t benchNanos() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+inline long benchArgument(int argc, char *argv[], int index, long fallback) {
+  return index < argc ? std::strtol(argv[index], nullptr, 10) : fallback;
+}
+
+// Value at `fraction` of the way through the samples, which are reordered.
+inline int64_t benchPercentile(std::vector<int64_t> &samples,
+                               double fraction) {
+  if (samples.empty()) {
+    return 0;
+  }
+
+  auto it = samples.begin() +
+            static_cast<size_t>(fraction * (samples.size() - 1));
+  std::nth_element(samples.begin(), it, samples.end());
+
+  return *it;
+}
+
+#define BENCH_CHECK(condition)                                                 \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      std::cerr << "Check failed: " #condition " (" << __FILE__ << ":"         \
+                << __LINE__ << ")" << std::endl;                               \
+      return 1;                                                                \
+    }                                                                          \
+  } while (false)
+
+#endif // BENCH_HPP
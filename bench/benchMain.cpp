@@ -0,0 +1,46 @@
+#include "bench.hpp"
+#include <cstring>
+
+namespace {
+
+struct Benchmark {
+  const char *name;
+  const char *usage;
+  int (*run)(int argc, char *argv[]);
+};
+
+const Benchmark benchmarks[] = {
+    {"allocations", "[history rows] [pages]", runAllocationBench},
+    {"archive", "[rows]", runArchiveBench},
+    {"backfill", "[users] [trades per user]", runBackfillBench},
+    {"backup", "[rows]", runBackupBench},
+    {"chart", "[bars]", runChartBench},
+    {"latency", "[clients] [buys per client]", runLatencyBench},
+    {"orderbook", "[resting orders] [ticks]", runOrderBookBench},
+    {"quotecache", "[max processes] [milliseconds]", runQuoteCacheBench},
+    {"shards", "[max shards] [processes] [trades per guild]", runShardBench},
+    {"symbols", "[symbols] [lookups]", runSymbolDirectoryBench},
+    {"tickstore", "[ticks]", runTickStoreBench},
+    {"upstream", "", runUpstreamBench},
+};
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  if (argc >= 2) {
+    for (const Benchmark &benchmark : benchmarks) {
+      if (std::strcmp(argv[1], benchmark.name) == 0) {
+        return benchmark.run(argc - 1, argv + 1);
+      }
+    }
+  }
+
+  std::cerr << "Usage:" << std::endl;
+
+  for (const Benchmark &benchmark : benchmarks) {
+    std::cerr << "  " << argv[0] << " " << benchmark.name << " "
+              << benchmark.usage << std::endl;
+  }
+
+  return 1;
+}
@@ -0,0 +1,15 @@
+#!/bin/bash
+
+cd ..
+
+rm -rf bench-build
+
+mkdir bench-build
+
+cd bench-build
+
+cmake ../bench/
+
+make
+
+ctest --output-on-failure
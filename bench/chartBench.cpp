@@ -0,0 +1,78 @@
+#include "../include/chartRenderer.hpp"
+#include "bench.hpp"
+#include <cmath>
+
+namespace {
+
+const int64_t benchMinuteMillis = static_cast<int64_t>(BarInterval::OneMinute);
+
+// A random walk of one-minute bars with a single spike in the middle.
+std::vector<Bar> makeBars(long count) {
+  std::vector<Bar> bars;
+  double price = 100.0;
+
+  for (long i = 0; i < count; i++) {
+    double open = price;
+    price = std::max(1.0, price + std::sin(i * 0.37) * 0.5);
+    double high = std::max(open, price) + 0.1;
+    double low = std::min(open, price) - 0.1;
+
+    if (i == count / 2) {
+      high = 1000.0;
+    }
+
+    bars.push_back(Bar{i * benchMinuteMillis, open, high, low, price});
+  }
+
+  return bars;
+}
+
+} // namespace
+
+// Times a /chart render from the bars a range query returns: downsampling to
+// one column per pixel and encoding the PNG. Both run for every uncached
+// chart, so together they should stay well under the reply deadline.
+int runChartBench(int argc, char *argv[]) {
+  long barCount = benchArgument(argc, argv, 1, 50000);
+  const int runs = 21;
+
+  BENCH_CHECK(barCount >= 2);
+
+  std::vector<Bar> bars = makeBars(barCount);
+  std::vector<int64_t> downsampleSamples;
+  std::vector<int64_t> renderSamples;
+  std::string image;
+
+  for (int i = 0; i < runs; i++) {
+    int64_t start = benchNanos();
+    std::vector<ChartColumn> columns = downsampleBars(bars, CHART_WIDTH);
+    int64_t downsampled = benchNanos();
+    image = renderChartPng(columns, CHART_WIDTH, CHART_HEIGHT);
+    int64_t rendered = benchNanos();
+
+    BENCH_CHECK(columns.size() ==
+                std::min<size_t>(bars.size(), CHART_WIDTH));
+    // Min/max bucketing keeps the spike.
+    BENCH_CHECK(std::any_of(
+        columns.begin(), columns.end(),
+        [](const ChartColumn &column) { return column.high == 1000.0; }));
+
+    downsampleSamples.push_back(downsampled - start);
+    renderSamples.push_back(rendered - downsampled);
+  }
+
+  int64_t downsampleNanos = benchPercentile(downsampleSamples, 0.5);
+  int64_t renderNanos = benchPercentile(renderSamples, 0.5);
+
+  BENCH_CHECK(image.compare(0, 8, "\x89PNG\r\n\x1a\n") == 0);
+  BENCH_CHECK(downsampleNanos + renderNanos < 50 * 1000000);
+
+  std::cout << "Chart: " << barCount << " bars to " << CHART_WIDTH << "x"
+            << CHART_HEIGHT << " PNG (" << image.size() << " bytes)"
+            << std::endl;
+  std::cout << "  downsample: " << downsampleNanos / 1000 << " us"
+            << std::endl;
+  std::cout << "  render: " << renderNanos / 1000 << " us" << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,182 @@
+#include "../include/databaseExecutor.hpp"
+#include "bench.hpp"
+#include <cstdio>
+#include <future>
+#include <memory>
+#include <thread>
+
+namespace {
+
+const char *latencyDbPath = "latency-bench.db";
+
+void removeDatabase() {
+  std::remove(latencyDbPath);
+  std::remove((std::string(latencyDbPath) + "-wal").c_str());
+  std::remove((std::string(latencyDbPath) + "-shm").c_str());
+}
+
+// The writes behind /buy: one share at $1, all or nothing.
+bool buy(DatabaseHandler &dbHandler, const std::string &userId) {
+  if (dbHandler.getUserBalance(userId) < 1.0 ||
+      !dbHandler.beginTransaction()) {
+    return false;
+  }
+
+  if (!dbHandler.updateUserBalance(userId, -1.0) ||
+      !dbHandler.updateUserStock(userId, "AAPL", 1, 1.0) ||
+      !dbHandler.updateTransactionsHistory(userId, "AAPL", 1, -1.0,
+                                           "2024-01-01 00:00:00") ||
+      !dbHandler.commitTransaction()) {
+    dbHandler.rollbackTransaction();
+    return false;
+  }
+
+  return true;
+}
+
+struct LatencyResult {
+  std::vector<int64_t> samples;
+  int64_t elapsedNanos = 0;
+  bool allCommitted = true;
+};
+
+// Runs `clients` threads that each send `requests` buys one after another,
+// timing each from sending it to getting its reply.
+template <typename Send>
+LatencyResult runClients(long clients, long requests, Send send) {
+  std::vector<std::vector<int64_t>> samples(clients);
+  std::vector<char> committed(clients, 1);
+  std::vector<std::thread> threads;
+  int64_t start = benchNanos();
+
+  for (long client = 0; client < clients; client++) {
+    threads.emplace_back([&, client] {
+      std::string userId = "user" + std::to_string(client);
+      samples[client].reserve(requests);
+
+      for (long i = 0; i < requests; i++) {
+        int64_t sent = benchNanos();
+        committed[client] &= send(client, userId);
+        samples[client].push_back(benchNanos() - sent);
+      }
+    });
+  }
+
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  LatencyResult result;
+  result.elapsedNanos = benchNanos() - start;
+
+  for (long client = 0; client < clients; client++) {
+    result.samples.insert(result.samples.end(), samples[client].begin(),
+                          samples[client].end());
+    result.allCommitted &= committed[client] != 0;
+  }
+
+  return result;
+}
+
+void printResult(const char *name, LatencyResult &result) {
+  double seconds = result.elapsedNanos / 1e9;
+
+  std::cout << "  " << name << ": p50 "
+            << benchPercentile(result.samples, 0.50) / 1000 << " us, p99 "
+            << benchPercentile(result.samples, 0.99) / 1000 << " us, "
+            << static_cast<long>(result.samples.size() / seconds)
+            << " buys/s" << std::endl;
+}
+
+bool balancesMatch(long clients, long requests) {
+  DatabaseHandler dbHandler(latencyDbPath);
+
+  for (long client = 0; client < clients; client++) {
+    std::string userId = "user" + std::to_string(client);
+
+    if (dbHandler.getUserBalance(userId) != STARTING_MONEY - requests ||
+        dbHandler.getUserStockQuantity(userId, "AAPL") != requests) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+} // namespace
+
+// Sends buys from concurrent clients and times each until its reply, first
+// with every client on its own connection committing alone, then through the
+// executor, which replies after the batch holding the buy has committed.
+int runLatencyBench(int argc, char *argv[]) {
+  long clients = benchArgument(argc, argv, 1, 16);
+  long requests = benchArgument(argc, argv, 2, 500);
+
+  BENCH_CHECK(requests < STARTING_MONEY);
+
+  removeDatabase();
+
+  {
+    DatabaseHandler dbHandler(latencyDbPath);
+    BENCH_CHECK(dbHandler.createTables());
+  }
+
+  std::vector<std::unique_ptr<DatabaseHandler>> connections;
+
+  for (long client = 0; client < clients; client++) {
+    connections.emplace_back(new DatabaseHandler(latencyDbPath));
+  }
+
+  LatencyResult direct =
+      runClients(clients, requests, [&](long client, const std::string &id) {
+        return buy(*connections[client], id);
+      });
+
+  connections.clear();
+
+  BENCH_CHECK(direct.allCommitted);
+  BENCH_CHECK(balancesMatch(clients, requests));
+
+  removeDatabase();
+
+  {
+    DatabaseHandler dbHandler(latencyDbPath);
+    BENCH_CHECK(dbHandler.createTables());
+  }
+
+  LatencyResult executor;
+
+  {
+    DatabaseExecutor dbExecutor(latencyDbPath, 1024);
+
+    executor =
+        runClients(clients, requests, [&](long, const std::string &userId) {
+          auto reply = std::make_shared<std::promise<bool>>();
+          std::future<bool> replied = reply->get_future();
+
+          dbExecutor.post([userId, reply](DatabaseHandler &dbHandler) {
+            if (!buy(dbHandler, userId)) {
+              reply->set_value(false);
+              return;
+            }
+
+            dbHandler.afterCommit(
+                [reply](bool committed) { reply->set_value(committed); });
+          });
+
+          return replied.get();
+        });
+  }
+
+  BENCH_CHECK(executor.allCommitted);
+  BENCH_CHECK(balancesMatch(clients, requests));
+
+  removeDatabase();
+
+  std::cout << "End-to-end buys: " << clients << " clients, " << requests
+            << " buys each" << std::endl;
+  printResult("connection per client", direct);
+  printResult("executor", executor);
+
+  return 0;
+}
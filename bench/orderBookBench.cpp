@@ -0,0 +1,122 @@
+#include "../include/orderBook.hpp"
+#include "bench.hpp"
+#include <random>
+
+namespace {
+
+bool triggersOnFall(const Order &order) {
+  return (order.side == OrderSide::Buy && order.type == OrderType::Limit) ||
+         (order.side == OrderSide::Sell && order.type == OrderType::Stop);
+}
+
+// A random order resting up to $20 away from `price` on the side where it
+// has not triggered yet.
+Order makeOrder(std::mt19937 &generator, int64_t orderId, double price) {
+  std::uniform_real_distribution<double> offset(0.01, 20.0);
+  std::uniform_int_distribution<int> kind(0, 3);
+
+  Order order;
+  order.orderId = orderId;
+  order.userId = std::to_string(orderId % 1000);
+  order.stockName = "AAPL";
+  order.side = (kind(generator) & 1) ? OrderSide::Sell : OrderSide::Buy;
+  order.type = (kind(generator) & 2) ? OrderType::Stop : OrderType::Limit;
+  order.quantity = 1;
+  order.triggerPrice = triggersOnFall(order) ? price - offset(generator)
+                                             : price + offset(generator);
+
+  return order;
+}
+
+} // namespace
+
+// Keeps the book at a fixed number of resting orders on one symbol while a
+// random walk of prices is matched against it, refilling whatever fills.
+int runOrderBookBench(int argc, char *argv[]) {
+  long restingOrders = benchArgument(argc, argv, 1, 100000);
+  long ticks = benchArgument(argc, argv, 2, 1000000);
+
+  std::mt19937 generator(42);
+  std::normal_distribution<double> step(0.0, 0.05);
+  double price = 100.0;
+  int64_t nextOrderId = 1;
+
+  OrderBook orderBook;
+  std::vector<Order> allOrders;
+
+  for (long i = 0; i < restingOrders; i++) {
+    Order order = makeOrder(generator, nextOrderId++, price);
+    orderBook.addOrder(order);
+    allOrders.push_back(order);
+  }
+
+  BENCH_CHECK(orderBook.size() == static_cast<size_t>(restingOrders));
+
+  // For scale: visiting every open order, which is what matching without the
+  // sorted books would cost per tick.
+  int64_t scanStart = benchNanos();
+  long scanTicks = std::min<long>(ticks, 1000);
+  size_t crossed = 0;
+
+  for (long i = 0; i < scanTicks; i++) {
+    double scanPrice = price + step(generator);
+
+    for (const Order &order : allOrders) {
+      crossed += triggersOnFall(order) ? order.triggerPrice >= scanPrice
+                                       : order.triggerPrice <= scanPrice;
+    }
+  }
+
+  int64_t scanNanos = (benchNanos() - scanStart) / std::max<long>(scanTicks, 1);
+  allOrders.clear();
+
+  std::vector<int64_t> samples;
+  samples.reserve(ticks);
+  int64_t matchingNanos = 0;
+  size_t fills = 0;
+
+  for (long i = 0; i < ticks; i++) {
+    price = std::max(1.0, price + step(generator));
+
+    int64_t start = benchNanos();
+    std::vector<Order> triggered = orderBook.onPrice("AAPL", price);
+    int64_t elapsed = benchNanos() - start;
+
+    samples.push_back(elapsed);
+    matchingNanos += elapsed;
+    fills += triggered.size();
+
+    for (const Order &order : triggered) {
+      BENCH_CHECK(triggersOnFall(order) ? order.triggerPrice >= price
+                                        : order.triggerPrice <= price);
+      orderBook.addOrder(makeOrder(generator, nextOrderId++, price));
+    }
+  }
+
+  BENCH_CHECK(orderBook.size() == static_cast<size_t>(restingOrders));
+  BENCH_CHECK(orderBook.onPrice("AAPL", price).empty());
+
+  std::cout << "Order book: " << restingOrders << " resting orders, " << ticks
+            << " ticks, " << fills << " fills" << std::endl;
+  std::cout << "  onPrice: mean " << matchingNanos / std::max<long>(ticks, 1)
+            << " ns, p50 " << benchPercentile(samples, 0.50) << " ns, p99 "
+            << benchPercentile(samples, 0.99) << " ns" << std::endl;
+  std::cout << "  scanning every order: " << scanNanos << " ns per tick ("
+            << crossed / std::max<long>(scanTicks, 1) << " crossed)"
+            << std::endl;
+
+  // An order placed here may commit after an older one placed elsewhere that
+  // has not been polled yet; polling must still pick the older one up.
+  OrderBook pollingBook;
+  Order older = makeOrder(generator, 11, price);
+  Order placed = makeOrder(generator, 12, price);
+
+  pollingBook.addOrder(placed);
+  BENCH_CHECK(pollingBook.getPolledOrderId() == 0);
+
+  pollingBook.addPolledOrders({older, placed});
+  BENCH_CHECK(pollingBook.size() == 2);
+  BENCH_CHECK(pollingBook.getPolledOrderId() == 12);
+
+  return 0;
+}
@@ -0,0 +1,170 @@
+#include "../include/quoteCache.hpp"
+#include "bench.hpp"
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+
+const int quoteSymbols = 20;
+const int upstreamMillis = 20;
+// Slower than a claim used to last, though within the upstream deadline.
+const int stalledUpstreamMillis = 3500;
+
+bool slowFetch(Quote &quote) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(upstreamMillis));
+  quote = {100.0, 1.0, 1.0};
+  return true;
+}
+
+// One bot process: asks for every symbol over and over until the deadline.
+int runQuoteClient(const std::string &name, int64_t deadline) {
+  QuoteCache cache(name);
+
+  if (!cache.isOpen()) {
+    return 1;
+  }
+
+  while (benchNanos() < deadline) {
+    for (int i = 0; i < quoteSymbols; i++) {
+      Quote quote;
+
+      if (!cache.getQuote("SYM" + std::to_string(i), quote, slowFetch) ||
+          quote.price != 100.0) {
+        return 1;
+      }
+    }
+  }
+
+  return 0;
+}
+
+// Upstream fetches made by `processes` processes sharing a fresh table, or
+// -1 if any of them failed.
+long countUpstreamFetches(const std::string &name, long processes,
+                          long millis) {
+  shm_unlink(name.c_str());
+
+  int64_t deadline = benchNanos() + millis * 1000000;
+  std::vector<pid_t> children;
+
+  for (long i = 0; i < processes; i++) {
+    pid_t pid = fork();
+
+    if (pid == 0) {
+      _exit(runQuoteClient(name, deadline));
+    }
+
+    children.push_back(pid);
+  }
+
+  bool succeeded = true;
+
+  for (pid_t child : children) {
+    int status = 0;
+    succeeded &= child > 0 && waitpid(child, &status, 0) == child &&
+                 WIFEXITED(status) && WEXITSTATUS(status) == 0;
+  }
+
+  QuoteCache cache(name);
+  long fetches = static_cast<long>(cache.getUpstreamFetches());
+  shm_unlink(name.c_str());
+
+  return succeeded ? fetches : -1;
+}
+
+} // namespace
+
+// Runs growing numbers of processes against one shared quote table and
+// counts the upstream fetches they make between them, which should stay flat
+// as processes are added. Then fills the table with unknown tickers to check
+// that their slots are reused.
+int runQuoteCacheBench(int argc, char *argv[]) {
+  long maxProcesses = benchArgument(argc, argv, 1, 8);
+  long millis = benchArgument(argc, argv, 2, 12000);
+  std::string name = "/stonk_market_bench_" + std::to_string(getpid());
+
+  std::cout << "Shared quote cache: " << quoteSymbols << " symbols for "
+            << millis << " ms, " << upstreamMillis << " ms upstream"
+            << std::endl;
+
+  long baseline = -1;
+
+  for (long processes = 1; processes <= maxProcesses; processes *= 2) {
+    long fetches = countUpstreamFetches(name, processes, millis);
+
+    BENCH_CHECK(fetches >= quoteSymbols);
+
+    if (baseline < 0) {
+      baseline = fetches;
+    }
+
+    std::cout << "  " << processes << " processes: " << fetches
+              << " upstream fetches" << std::endl;
+
+    // One fetch per symbol per TTL, plus one more per symbol for a refresh
+    // that lands right at the deadline.
+    BENCH_CHECK(fetches <= baseline + quoteSymbols);
+  }
+
+  shm_unlink(name.c_str());
+
+  {
+    QuoteCache cache(name);
+    BENCH_CHECK(cache.isOpen());
+
+    auto unknown = [](Quote &) { return false; };
+
+    for (int i = 0; i < QUOTE_CACHE_SLOTS * 2; i++) {
+      Quote quote;
+      BENCH_CHECK(!cache.getQuote("BAD" + std::to_string(i), quote, unknown));
+    }
+
+    uint64_t before = cache.getUpstreamFetches();
+    Quote quote;
+
+    BENCH_CHECK(cache.getQuote("GOOD", quote, slowFetch));
+    BENCH_CHECK(cache.getQuote("GOOD", quote, slowFetch));
+    BENCH_CHECK(cache.getUpstreamFetches() == before + 1);
+  }
+
+  shm_unlink(name.c_str());
+
+  // One process fetches from a stalled upstream while another asks for the
+  // same symbol; the second waits for the first instead of fetching too.
+  {
+    QuoteCache cache(name);
+    BENCH_CHECK(cache.isOpen());
+
+    pid_t pid = fork();
+
+    if (pid == 0) {
+      QuoteCache childCache(name);
+      Quote quote;
+
+      _exit(childCache.getQuote("SLOW", quote, [](Quote &fetched) {
+        std::this_thread::sleep_for(
+            std::chrono::milliseconds(stalledUpstreamMillis));
+        fetched = {100.0, 1.0, 1.0};
+        return true;
+      })
+                ? 0
+                : 1);
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    Quote quote;
+    int status = 0;
+
+    BENCH_CHECK(cache.getQuote("SLOW", quote, slowFetch));
+    BENCH_CHECK(pid > 0 && waitpid(pid, &status, 0) == pid &&
+                WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    BENCH_CHECK(cache.getUpstreamFetches() == 1);
+  }
+
+  shm_unlink(name.c_str());
+
+  return 0;
+}
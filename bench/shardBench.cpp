@@ -0,0 +1,313 @@
+#include "../include/storageRouter.hpp"
+#include "bench.hpp"
+#include <filesystem>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+
+const size_t shardGuilds = 8;
+const int accountsPerGuild = 50;
+
+std::string getShardBenchDirectory(size_t shards) {
+  return "shard-bench-" + std::to_string(shards) + "/";
+}
+
+StorageRouter *openRouter(const std::string &directory, size_t shards) {
+  return new StorageRouter(directory + "shards.db", directory + "game.db",
+                           directory + "archive.db", shards);
+}
+
+// Creates the shards and picks guilds spread evenly over them, so the runs
+// compare shard counts rather than how the hash happened to fall.
+bool prepareShards(const std::string &directory, size_t shards,
+                   std::vector<uint64_t> &guilds) {
+  std::filesystem::remove_all(directory);
+  std::filesystem::create_directories(directory);
+
+  std::unique_ptr<StorageRouter> storage(openRouter(directory, shards));
+
+  if (!storage->isOpen()) {
+    return false;
+  }
+
+  for (size_t i = 0; i < storage->size(); i++) {
+    bool created = storage->getShard(i)
+                       .executor
+                       ->submit([](DatabaseHandler &dbHandler) {
+                         return dbHandler.createTables();
+                       })
+                       .get();
+
+    if (!created) {
+      return false;
+    }
+  }
+
+  std::vector<size_t> perShard(shards, 0);
+
+  for (uint64_t guildId = 1; guilds.size() < shardGuilds; guildId++) {
+    size_t index = storage->getShardForGuild(guildId).index;
+
+    if (perShard[index] < shardGuilds / shards) {
+      perShard[index]++;
+      guilds.push_back(guildId);
+    }
+  }
+
+  return true;
+}
+
+// One bot process: trades in its share of the guilds, a thread per guild,
+// each waiting for its trade to commit before sending the next.
+int runShardClient(const std::string &directory, size_t shards,
+                   const std::vector<uint64_t> &guilds, long process,
+                   long processes, long trades) {
+  std::unique_ptr<StorageRouter> storage(openRouter(directory, shards));
+
+  if (!storage->isOpen()) {
+    return 1;
+  }
+
+  std::vector<std::thread> threads;
+  std::vector<char> committed(guilds.size(), 1);
+
+  for (size_t i = process; i < guilds.size(); i += processes) {
+    threads.emplace_back([&, i] {
+      DatabaseExecutor &dbExecutor =
+          *storage->getShardForGuild(guilds[i]).executor;
+
+      for (long trade = 0; trade < trades; trade++) {
+        std::string accountId = StorageRouter::getAccountId(
+            guilds[i], static_cast<uint64_t>(trade % accountsPerGuild));
+
+        committed[i] &=
+            dbExecutor
+                .submit([accountId](DatabaseHandler &dbHandler) {
+                  return dbHandler.updateUserBalance(accountId, -1.0) &&
+                         dbHandler.updateUserStock(accountId, "AAPL", 1,
+                                                   1.0) &&
+                         dbHandler.updateTransactionsHistory(
+                             accountId, "AAPL", 1, -1.0,
+                             "2024-01-01 00:00:00");
+                })
+                .get();
+      }
+    });
+  }
+
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  for (char guildCommitted : committed) {
+    if (!guildCommitted) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+int64_t countRows(StorageShard &shard, const std::string &table) {
+  return shard.executor
+      ->submit([table](DatabaseHandler &dbHandler) {
+        int64_t count = 0;
+        std::string query = "SELECT COUNT(*) FROM " + table;
+        sqlite3_stmt *stmt;
+
+        if (sqlite3_prepare_v2(dbHandler.getConnection(), query.c_str(), -1,
+                               &stmt, nullptr) == SQLITE_OK) {
+          if (sqlite3_step(stmt) == SQLITE_ROW) {
+            count = sqlite3_column_int64(stmt, 0);
+          }
+
+          sqlite3_finalize(stmt);
+        }
+
+        return count;
+      })
+      .get();
+}
+
+int64_t countTrades(const std::string &directory, size_t shards) {
+  std::unique_ptr<StorageRouter> storage(openRouter(directory, shards));
+  int64_t total = 0;
+
+  for (size_t i = 0; i < storage->size(); i++) {
+    total += countRows(storage->getShard(i), "main.user_transactions");
+  }
+
+  return total;
+}
+
+// Trades per second over `shards` shards, or -1 if any trade was lost.
+double measureShards(size_t shards, long processes, long trades) {
+  std::string directory = getShardBenchDirectory(shards);
+  std::vector<uint64_t> guilds;
+
+  if (!prepareShards(directory, shards, guilds)) {
+    return -1.0;
+  }
+
+  // Forked only after the setup router is gone, so no child inherits its
+  // threads.
+  int64_t start = benchNanos();
+  std::vector<pid_t> children;
+
+  for (long process = 0; process < processes; process++) {
+    pid_t pid = fork();
+
+    if (pid == 0) {
+      _exit(runShardClient(directory, shards, guilds, process, processes,
+                           trades));
+    }
+
+    children.push_back(pid);
+  }
+
+  bool succeeded = true;
+
+  for (pid_t child : children) {
+    int status = 0;
+    succeeded &= child > 0 && waitpid(child, &status, 0) == child &&
+                 WIFEXITED(status) && WEXITSTATUS(status) == 0;
+  }
+
+  double seconds = (benchNanos() - start) / 1e9;
+  bool complete =
+      countTrades(directory, shards) ==
+      static_cast<int64_t>(guilds.size()) * static_cast<int64_t>(trades);
+
+  std::filesystem::remove_all(directory);
+
+  if (!succeeded || !complete) {
+    return -1.0;
+  }
+
+  return guilds.size() * trades / seconds;
+}
+
+// Moves a guild with archived trades to the other shard, then reruns the
+// move as if the first had died after repointing the catalog but before
+// clearing the source.
+bool checkMoveGuild() {
+  std::string directory = "shard-move-bench/";
+  std::filesystem::remove_all(directory);
+  std::filesystem::create_directories(directory);
+
+  std::unique_ptr<StorageRouter> storage(openRouter(directory, 2));
+
+  for (size_t i = 0; storage->isOpen() && i < storage->size(); i++) {
+    std::string archivePath = storage->getShard(i).archivePath;
+    bool created = storage->getShard(i)
+                       .executor
+                       ->submit(
+                           [archivePath](DatabaseHandler &dbHandler) {
+                             return dbHandler.createTables() &&
+                                    dbHandler.attachArchive(archivePath);
+                           },
+                           false)
+                       .get();
+
+    if (!created) {
+      return false;
+    }
+  }
+
+  const uint64_t guildId = 1;
+  std::string accountId = StorageRouter::getAccountId(guildId, 1);
+  StorageShard &source = storage->getShardForGuild(guildId);
+  size_t toIndex = 1 - source.index;
+
+  // Three trades, the first two of them archived.
+  bool traded =
+      source.executor
+          ->submit(
+              [accountId](DatabaseHandler &dbHandler) {
+                for (int i = 0; i < 3; i++) {
+                  if (!dbHandler.updateTransactionsHistory(
+                          accountId, "AAPL", 1, -1.0,
+                          "2024-01-01 00:00:0" + std::to_string(i))) {
+                    return false;
+                  }
+                }
+
+                return dbHandler.archiveTransactions(
+                           dbHandler.getLastTransactionIdBefore(
+                               "2024-01-01 00:00:02"),
+                           100) == 2;
+              },
+              false)
+          .get();
+
+  if (!traded || !storage->moveGuild(guildId, toIndex)) {
+    return false;
+  }
+
+  StorageShard &target = storage->getShard(toIndex);
+  std::pmr::vector<TransactionRecord> history =
+      target.executor
+          ->submit([accountId](DatabaseHandler &dbHandler) {
+            return dbHandler.getUserHistoryPage(accountId, INT64_MAX, true,
+                                                10);
+          })
+          .get();
+
+  bool moved = countRows(target, "archive.user_transactions") == 2 &&
+               countRows(target, "main.user_transactions") == 1 &&
+               countRows(source, "archive.user_transactions") == 0 &&
+               history.size() == 3 &&
+               history[0].timestamp == "2024-01-01 00:00:02" &&
+               history[2].timestamp == "2024-01-01 00:00:00";
+
+  // A leftover row on the old shard, as a move that died before its deletes
+  // would leave.
+  bool leftover = source.executor
+                      ->submit([accountId](DatabaseHandler &dbHandler) {
+                        return dbHandler.updateTransactionsHistory(
+                            accountId, "AAPL", 1, -1.0,
+                            "2024-01-01 00:00:00");
+                      })
+                      .get();
+
+  bool rerun = leftover && storage->moveGuild(guildId, toIndex) &&
+               countRows(source, "main.user_transactions") == 0 &&
+               countRows(target, "main.user_transactions") == 1;
+
+  storage.reset();
+  std::filesystem::remove_all(directory);
+
+  return moved && rerun;
+}
+
+} // namespace
+
+// Runs the same trades from several bot processes against one database file
+// and then against guilds spread over more shards. Shards only help when
+// commits wait on the disk: each file has one writer, so guilds on different
+// shards commit in parallel, but on a disk with cheap fsyncs a single file
+// is already fast enough that the numbers barely move.
+int runShardBench(int argc, char *argv[]) {
+  long maxShards = benchArgument(argc, argv, 1, 4);
+  long processes = benchArgument(argc, argv, 2, 4);
+  long trades = benchArgument(argc, argv, 3, 500);
+
+  BENCH_CHECK(maxShards >= 1 && maxShards <= static_cast<long>(shardGuilds));
+  BENCH_CHECK(trades / accountsPerGuild < STARTING_MONEY);
+  BENCH_CHECK(checkMoveGuild());
+
+  std::cout << "Sharded trades: " << shardGuilds << " guilds, " << processes
+            << " processes, " << trades << " trades per guild" << std::endl;
+
+  for (long shards = 1; shards <= maxShards; shards *= 2) {
+    double rate = measureShards(shards, processes, trades);
+
+    BENCH_CHECK(rate > 0.0);
+    std::cout << "  " << shards << " shards: " << static_cast<long>(rate)
+              << " trades/s" << std::endl;
+  }
+
+  return 0;
+}
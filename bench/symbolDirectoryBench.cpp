@@ -0,0 +1,144 @@
+#include "../include/symbolDirectory.hpp"
+#include "bench.hpp"
+#include <atomic>
+#include <cstdio>
+#include <thread>
+
+namespace {
+
+const char *symbolCachePath = "symbol-bench.txt";
+
+// Four-letter tickers spelled from the 13 letters starting at `first`, so two
+// lists built from different halves of the alphabet share no prefix.
+std::vector<std::string> makeSymbols(long count, char first) {
+  std::vector<std::string> symbols;
+
+  for (long i = 0; i < count; i++) {
+    std::string symbol(4, first);
+
+    for (long n = i, position = 3; position >= 0; n /= 13, position--) {
+      symbol[position] = static_cast<char>(first + n % 13);
+    }
+
+    symbols.push_back(symbol);
+  }
+
+  return symbols;
+}
+
+// Completions of one prefix, taken from a single snapshot: every entry in
+// order, carrying the prefix and spelled from one list.
+bool isConsistent(const std::vector<std::string> &matches,
+                  const std::string &prefix) {
+  for (size_t i = 0; i < matches.size(); i++) {
+    if (matches[i].compare(0, prefix.size(), prefix) != 0 ||
+        (i > 0 && (matches[i - 1] >= matches[i] ||
+                   (matches[i - 1][0] < 'N') != (matches[i][0] < 'N')))) {
+      return false;
+    }
+  }
+
+  return matches.size() <= SYMBOL_COMPLETION_LIMIT;
+}
+
+} // namespace
+
+// Times exact lookups and completions, then swaps in a new list while
+// readers complete prefixes. Each reader must always see one whole list,
+// and once the swap is done only the new one, in this process and in
+// another that reloads the cache file.
+int runSymbolDirectoryBench(int argc, char *argv[]) {
+  long count = benchArgument(argc, argv, 1, 20000);
+  long lookups = benchArgument(argc, argv, 2, 100000);
+
+  BENCH_CHECK(count > 0 && count <= 13 * 13 * 13 * 13);
+
+  std::remove(symbolCachePath);
+
+  std::vector<std::string> before = makeSymbols(count, 'A');
+  std::vector<std::string> after = makeSymbols(count, 'N');
+  SymbolDirectory directory(symbolCachePath);
+
+  BENCH_CHECK(directory.store(before));
+  BENCH_CHECK(directory.contains(before.back()));
+  BENCH_CHECK(!directory.contains(after.front()));
+
+  std::vector<std::string> matches = directory.complete("A");
+  BENCH_CHECK(matches.size() ==
+              std::min<size_t>(count, SYMBOL_COMPLETION_LIMIT));
+  BENCH_CHECK(matches.front() == before.front());
+  BENCH_CHECK(isConsistent(matches, "A"));
+  BENCH_CHECK(directory.complete(before.back()) ==
+              std::vector<std::string>{before.back()});
+
+  int64_t start = benchNanos();
+
+  for (long i = 0; i < lookups; i++) {
+    BENCH_CHECK(directory.contains(before[i % count]));
+  }
+
+  int64_t containsNanos = (benchNanos() - start) / std::max(lookups, 1L);
+  start = benchNanos();
+
+  for (long i = 0; i < lookups; i++) {
+    BENCH_CHECK(!directory.complete(before[i % count].substr(0, 2)).empty());
+  }
+
+  int64_t completeNanos = (benchNanos() - start) / std::max(lookups, 1L);
+
+  // Readers complete while the list is swapped back and forth.
+  std::atomic<bool> swapping{true};
+  std::atomic<long> inconsistent{0};
+  std::vector<std::thread> readers;
+
+  for (int reader = 0; reader < 4; reader++) {
+    readers.emplace_back([&directory, &swapping, &inconsistent, reader]() {
+      const char *prefixes[] = {"A", "N", "AB", "NO"};
+
+      while (swapping.load()) {
+        const char *prefix = prefixes[reader];
+
+        if (!isConsistent(directory.complete(prefix), prefix)) {
+          inconsistent++;
+        }
+      }
+    });
+  }
+
+  for (int swap = 0; swap < 20; swap++) {
+    BENCH_CHECK(directory.store(swap % 2 ? after : before));
+  }
+
+  swapping = false;
+
+  for (std::thread &reader : readers) {
+    reader.join();
+  }
+
+  BENCH_CHECK(inconsistent.load() == 0);
+
+  // The last swap left the second list.
+  BENCH_CHECK(directory.complete("A").empty());
+  BENCH_CHECK(directory.complete("N").front() == after.front());
+  BENCH_CHECK(directory.contains(after.back()));
+  BENCH_CHECK(!directory.contains(before.back()));
+
+  // Another process picks up each rewrite of the file, however soon after
+  // the last one it comes.
+  SymbolDirectory other(symbolCachePath);
+  BENCH_CHECK(other.reload());
+  BENCH_CHECK(other.complete("N").front() == after.front());
+
+  BENCH_CHECK(directory.store(before));
+  BENCH_CHECK(other.reload());
+  BENCH_CHECK(other.complete("N").empty());
+  BENCH_CHECK(other.complete("A").front() == before.front());
+
+  std::cout << "Symbol directory: " << count << " symbols" << std::endl;
+  std::cout << "  contains: " << containsNanos << " ns" << std::endl;
+  std::cout << "  complete: " << completeNanos << " ns" << std::endl;
+
+  std::remove(symbolCachePath);
+
+  return 0;
+}
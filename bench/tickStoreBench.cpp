@@ -0,0 +1,177 @@
+#include "../include/tickStore.hpp"
+#include "bench.hpp"
+#include <filesystem>
+#include <fstream>
+
+namespace {
+
+const char *tickStorePath = "tick-bench";
+const int64_t benchDayMillis = static_cast<int64_t>(BarInterval::OneDay);
+const int64_t benchHourMillis = static_cast<int64_t>(BarInterval::OneHour);
+// 2024-01-01, a day long enough ago to compact.
+const int64_t firstDay = 19723 * benchDayMillis;
+
+// Resident memory of this process in kilobytes.
+long residentKilobytes() {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+
+  while (std::getline(status, line)) {
+    if (line.compare(0, 6, "VmRSS:") == 0) {
+      return std::strtol(line.c_str() + 6, nullptr, 10);
+    }
+  }
+
+  return -1;
+}
+
+long openDescriptors() {
+  std::error_code ec;
+  long count = 0;
+
+  for (auto it = std::filesystem::directory_iterator("/proc/self/fd", ec);
+       it != std::filesystem::directory_iterator(); it.increment(ec)) {
+    count++;
+  }
+
+  return count;
+}
+
+std::string segmentFile(const std::string &symbol,
+                        const std::string &extension) {
+  return std::string(tickStorePath) + "/" + symbol + "/20240101" + extension;
+}
+
+// Median time of `runs` calls to getBars over [from, to).
+int64_t timeQuery(TickStore &tickStore, int64_t from, int64_t to,
+                  size_t &barCount) {
+  const int runs = 9;
+  std::vector<int64_t> samples;
+
+  for (int i = 0; i < runs; i++) {
+    int64_t start = benchNanos();
+    barCount = tickStore.getBars("AAPL", from, to, BarInterval::OneMinute)
+                   .size();
+    samples.push_back(benchNanos() - start);
+  }
+
+  return benchPercentile(samples, 0.5);
+}
+
+} // namespace
+
+// Appends a day of ticks and checks that memory stays flat and range queries
+// stay fast however many ticks the day holds. Then checks the recovery paths:
+// columns left uneven by a crashed writer, a compaction that crashed before
+// removing the raw files, and the cap on open segments.
+int runTickStoreBench(int argc, char *argv[]) {
+  long ticks = benchArgument(argc, argv, 1, 2000000);
+
+  BENCH_CHECK(ticks > 0 && ticks <= benchDayMillis);
+
+  std::filesystem::remove_all(tickStorePath);
+
+  {
+    TickStore tickStore(tickStorePath);
+    int64_t spacing = benchDayMillis / ticks;
+    long residentBefore = residentKilobytes();
+    int64_t start = benchNanos();
+
+    for (long i = 0; i < ticks; i++) {
+      BENCH_CHECK(tickStore.appendTick("AAPL", firstDay + i * spacing,
+                                       100.0 + (i % 1000) * 0.01));
+    }
+
+    int64_t appendNanos = (benchNanos() - start) / ticks;
+
+    size_t dayBars = 0;
+    size_t hourBars = 0;
+    int64_t dayNanos =
+        timeQuery(tickStore, firstDay, firstDay + benchDayMillis, dayBars);
+    int64_t hourNanos = timeQuery(tickStore, firstDay + 12 * benchHourMillis,
+                                  firstDay + 13 * benchHourMillis, hourBars);
+    long residentGrowth = residentKilobytes() - residentBefore;
+
+    BENCH_CHECK(dayBars > 0 && hourBars > 0 && hourBars <= 60);
+    // The segments are mapped only while a query reads them.
+    BENCH_CHECK(residentGrowth < 8 * 1024);
+    BENCH_CHECK(hourNanos < 10 * 1000000);
+
+    std::cout << "Tick store: " << ticks << " ticks in one day" << std::endl;
+    std::cout << "  append: " << appendNanos << " ns per tick" << std::endl;
+    std::cout << "  1m bars over the day: " << dayNanos / 1000 << " us"
+              << std::endl;
+    std::cout << "  1m bars over an hour: " << hourNanos / 1000 << " us"
+              << std::endl;
+    std::cout << "  resident growth: " << residentGrowth << " KB" << std::endl;
+  }
+
+  std::filesystem::remove_all(tickStorePath);
+
+  // A writer that died between its two writes left a timestamp without a
+  // price; the next append evens the columns before adding its own tick.
+  {
+    TickStore tickStore(tickStorePath);
+    BENCH_CHECK(tickStore.appendTick("MSFT", firstDay, 1.0));
+
+    {
+      std::ofstream orphan(segmentFile("MSFT", ".ts"),
+                           std::ios::binary | std::ios::app);
+      int64_t timestamp = firstDay + 1;
+      orphan.write(reinterpret_cast<const char *>(&timestamp),
+                   sizeof(timestamp));
+    }
+
+    BENCH_CHECK(tickStore.appendTick("MSFT", firstDay + 2, 2.0));
+
+    std::vector<Tick> msft =
+        tickStore.getTicks("MSFT", firstDay, firstDay + benchDayMillis);
+
+    BENCH_CHECK(std::filesystem::file_size(segmentFile("MSFT", ".ts")) ==
+                std::filesystem::file_size(segmentFile("MSFT", ".px")));
+    BENCH_CHECK(msft.size() == 2);
+    BENCH_CHECK(msft[1].timestamp == firstDay + 2 && msft[1].price == 2.0);
+  }
+
+  // A compaction that crashed after writing the bars but before removing the
+  // raw segment leaves both; each point is still read once.
+  {
+    TickStore tickStore(tickStorePath);
+    const int minutes = 30;
+
+    for (int i = 0; i < minutes * 10; i++) {
+      BENCH_CHECK(tickStore.appendTick("IBM", firstDay + i * 6000, 1.0 + i));
+    }
+
+    std::filesystem::copy_file(segmentFile("IBM", ".ts"), "ibm.ts");
+    std::filesystem::copy_file(segmentFile("IBM", ".px"), "ibm.px");
+    BENCH_CHECK(tickStore.compactSegments(firstDay + benchDayMillis));
+    std::filesystem::rename("ibm.ts", segmentFile("IBM", ".ts"));
+    std::filesystem::rename("ibm.px", segmentFile("IBM", ".px"));
+
+    BENCH_CHECK(tickStore.getTicks("IBM", firstDay, firstDay + benchDayMillis)
+                    .size() == minutes);
+  }
+
+  // Appending to many symbols keeps only a bounded number of them open.
+  {
+    TickStore tickStore(tickStorePath);
+    long descriptorsBefore = openDescriptors();
+
+    for (int i = 0; i < TICK_OPEN_SEGMENTS_MAX * 2; i++) {
+      BENCH_CHECK(
+          tickStore.appendTick("SYM" + std::to_string(i), firstDay, 1.0));
+    }
+
+    BENCH_CHECK(openDescriptors() - descriptorsBefore <=
+                2 * TICK_OPEN_SEGMENTS_MAX);
+    BENCH_CHECK(tickStore.appendTick("SYM0", firstDay + 1, 2.0));
+    BENCH_CHECK(
+        tickStore.getTicks("SYM0", firstDay, firstDay + benchDayMillis)
+            .size() == 2);
+  }
+
+  std::filesystem::remove_all(tickStorePath);
+
+  return 0;
+}
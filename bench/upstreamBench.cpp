@@ -0,0 +1,242 @@
+#include "../include/upstreamClient.hpp"
+#include "bench.hpp"
+#include <arpa/inet.h>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+
+// What the stub does with one request.
+struct Fault {
+  int status;
+  int stallMillis;
+};
+
+// HTTP server on 127.0.0.1 that answers each connection with the next
+// scripted fault, or the default one once the script runs out. Every
+// connection is served on its own thread, so a stalled one does not hold up
+// a hedge racing it.
+class UpstreamStub {
+private:
+  int listener = -1;
+  int port = 0;
+  std::thread acceptor;
+  std::mutex mutex;
+  std::deque<Fault> script;
+  Fault fallback = {200, 0};
+  std::vector<std::thread> handlers;
+  std::atomic<long> served{0};
+
+  Fault nextFault() {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (script.empty()) {
+      return fallback;
+    }
+
+    Fault fault = script.front();
+    script.pop_front();
+
+    return fault;
+  }
+
+  void serve(int client) {
+    std::string request;
+    char buffer[1024];
+
+    while (request.find("\r\n\r\n") == std::string::npos) {
+      ssize_t received = recv(client, buffer, sizeof(buffer), 0);
+
+      if (received <= 0) {
+        close(client);
+        return;
+      }
+
+      request.append(buffer, received);
+    }
+
+    served++;
+    Fault fault = nextFault();
+    std::this_thread::sleep_for(std::chrono::milliseconds(fault.stallMillis));
+
+    std::string body = fault.status == 200 ? "{\"c\":100}" : "error";
+    std::string response = "HTTP/1.1 " + std::to_string(fault.status) +
+                           " Stub\r\nContent-Length: " +
+                           std::to_string(body.size()) +
+                           "\r\nConnection: close\r\n\r\n" + body;
+
+    // The client may have given up on a stalled request already.
+    send(client, response.data(), response.size(), MSG_NOSIGNAL);
+    close(client);
+  }
+
+  void run() {
+    while (true) {
+      int client = accept(listener, nullptr, nullptr);
+
+      if (client < 0) {
+        break;
+      }
+
+      std::lock_guard<std::mutex> lock(mutex);
+      handlers.emplace_back(&UpstreamStub::serve, this, client);
+    }
+  }
+
+public:
+  UpstreamStub() {
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+
+    if (listener < 0 ||
+        bind(listener, reinterpret_cast<sockaddr *>(&address), length) != 0 ||
+        listen(listener, 64) != 0 ||
+        getsockname(listener, reinterpret_cast<sockaddr *>(&address),
+                    &length) != 0) {
+      return;
+    }
+
+    port = ntohs(address.sin_port);
+    acceptor = std::thread(&UpstreamStub::run, this);
+  }
+
+  ~UpstreamStub() {
+    if (listener >= 0) {
+      shutdown(listener, SHUT_RDWR);
+      close(listener);
+    }
+
+    if (acceptor.joinable()) {
+      acceptor.join();
+    }
+
+    for (std::thread &handler : handlers) {
+      handler.join();
+    }
+  }
+
+  bool isListening() const { return port != 0; }
+
+  std::string getUrl() const {
+    return "http://127.0.0.1:" + std::to_string(port) + "/quote";
+  }
+
+  // Replaces the script and the fault used once it runs out.
+  void inject(std::deque<Fault> faults, Fault otherwise) {
+    std::lock_guard<std::mutex> lock(mutex);
+    script = std::move(faults);
+    fallback = otherwise;
+  }
+
+  long getServed() const { return served.load(); }
+};
+
+const Fault healthy = {200, 0};
+const Fault serverError = {503, 0};
+const Fault clientError = {404, 0};
+// Longer than a single attempt may take, so only the deadline ends the call.
+const Fault blackHole = {200, UPSTREAM_REQUEST_TIMEOUT_MILLIS + 1000};
+
+int64_t timedGet(UpstreamClient &client, const std::string &url, bool &ok) {
+  std::string body;
+  int64_t start = benchNanos();
+  ok = client.get(url, body);
+
+  return (benchNanos() - start) / 1000000;
+}
+
+} // namespace
+
+// Injects stalls and errors from a local stub server into the upstream
+// client and checks that the hedge, retries, deadline and circuit breaker
+// each do their part.
+int runUpstreamBench(int /*argc*/, char * /*argv*/[]) {
+  UpstreamStub stub;
+  BENCH_CHECK(stub.isListening());
+
+  UpstreamClient client;
+  std::string url = stub.getUrl();
+  bool ok = false;
+
+  // A request stalled past the hedge delay is raced, and the hedge wins.
+  int stallMillis = UPSTREAM_HEDGE_DEFAULT_MILLIS * 3;
+  stub.inject({{200, stallMillis}}, healthy);
+  int64_t millis = timedGet(client, url, ok);
+
+  BENCH_CHECK(ok);
+  BENCH_CHECK(millis < stallMillis);
+  BENCH_CHECK(client.getStats().hedges == 1);
+  BENCH_CHECK(client.getStats().hedgeWins == 1);
+  std::cout << "Stalled request: hedged, answered in " << millis << " ms"
+            << std::endl;
+
+  // Server errors are retried.
+  stub.inject({serverError, serverError}, healthy);
+  millis = timedGet(client, url, ok);
+
+  BENCH_CHECK(ok);
+  BENCH_CHECK(client.getStats().retries == 2);
+  std::cout << "Two server errors: retried, answered in " << millis << " ms"
+            << std::endl;
+
+  // Client errors are neither retried nor counted against the upstream.
+  stub.inject({}, clientError);
+
+  for (int i = 0; i < UPSTREAM_BREAKER_FAILURES * 2; i++) {
+    timedGet(client, url, ok);
+    BENCH_CHECK(!ok);
+  }
+
+  BENCH_CHECK(client.getStats().retries == 2);
+  BENCH_CHECK(!client.isOpen());
+  std::cout << "Client errors: not retried, breaker closed" << std::endl;
+
+  // An upstream that never answers costs no more than the deadline, and
+  // counts as one failure however many attempts that took.
+  stub.inject({}, blackHole);
+  millis = timedGet(client, url, ok);
+
+  BENCH_CHECK(!ok);
+  BENCH_CHECK(millis >= UPSTREAM_REQUEST_TIMEOUT_MILLIS);
+  BENCH_CHECK(millis < UPSTREAM_DEADLINE_MILLIS + 500);
+  BENCH_CHECK(!client.isOpen());
+  std::cout << "Black hole: gave up after " << millis << " ms" << std::endl;
+
+  // A success clears the count, then the breaker opens on the failed call
+  // that reaches UPSTREAM_BREAKER_FAILURES and fails fast after that.
+  stub.inject({}, healthy);
+  timedGet(client, url, ok);
+  BENCH_CHECK(ok);
+
+  stub.inject({}, serverError);
+
+  for (int i = 0; i < UPSTREAM_BREAKER_FAILURES; i++) {
+    BENCH_CHECK(!client.isOpen());
+    timedGet(client, url, ok);
+    BENCH_CHECK(!ok);
+  }
+
+  BENCH_CHECK(client.isOpen());
+
+  long served = stub.getServed();
+  uint64_t rejected = client.getStats().rejected;
+  millis = timedGet(client, url, ok);
+
+  BENCH_CHECK(!ok);
+  BENCH_CHECK(stub.getServed() == served);
+  BENCH_CHECK(client.getStats().rejected == rejected + 1);
+  std::cout << "Failing upstream: breaker opened after "
+            << UPSTREAM_BREAKER_FAILURES << " calls, then rejected in "
+            << millis << " ms" << std::endl;
+
+  return 0;
+}
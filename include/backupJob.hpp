@@ -0,0 +1,84 @@
+#ifndef BACKUP_JOB_HPP
+#define BACKUP_JOB_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+
+#include "databaseExecutor.hpp"
+
+#define BACKUP_STEP_PAGES 64
+#define BACKUP_STEP_PAUSE_MILLIS 10
+// Writes from other processes restart the copy. After this many restarts
+// the rest is copied in a single step, which holds a read transaction on the
+// source until it is done.
+#define BACKUP_MAX_RESTARTS 3
+#define BACKUP_BUDGET_MILLIS (10 * 60 * 1000)
+#define BACKUP_KEEP_COUNT 7
+
+struct BackupResult {
+  bool success = false;
+  std::string path;
+  int64_t durationMillis = 0;
+  // Longest single step, which is the longest any queued trade waited on
+  // the backup.
+  int64_t maxStallMicros = 0;
+  int steps = 0;
+  int restarts = 0;
+};
+
+// Copies the live database into timestamped snapshots with the SQLite online
+// backup API. Each step copies a few pages on the executor thread, using the
+// executor's own connection so trades committed between steps are folded into
+// the snapshot instead of restarting it. The job pauses between steps so
+// queued commands run in between. Trades committed by other processes do
+// restart it, so a copy that keeps restarting finishes in one step instead,
+// and a backup that outlasts BACKUP_BUDGET_MILLIS fails. The attached
+// archive is copied alongside
+// each snapshot, since archived rows are no longer in the live database.
+// Only the newest snapshots are kept.
+class BackupJob {
+private:
+  DatabaseExecutor &dbExecutor;
+  std::string backupDir;
+  size_t keepCount;
+
+  std::atomic<bool> running{false};
+  std::atomic<bool> stopping{false};
+  std::thread worker;
+
+  int copySchema(const char *schema, const std::string &path,
+                 std::chrono::steady_clock::time_point deadline,
+                 BackupResult &result);
+  BackupResult run();
+  void rotate();
+
+  static bool restoreFile(const std::string &backupPath,
+                          const std::string &dbPath);
+
+public:
+  BackupJob(DatabaseExecutor &dbExecutor, const std::string &backupDir,
+            size_t keepCount = BACKUP_KEEP_COUNT);
+  ~BackupJob();
+
+  BackupJob(const BackupJob &) = delete;
+  BackupJob &operator=(const BackupJob &) = delete;
+
+  // Starts a backup in the background and reports to `done` from the backup
+  // thread. Returns false if a backup is already running.
+  bool start(std::function<void(const BackupResult &)> done);
+
+  // Overwrites the database at `dbPath` with a snapshot, and the archive at
+  // `archivePath` with the snapshot's archive copy if it has one. Must run
+  // before anything opens either file.
+  static bool restore(const std::string &backupPath, const std::string &dbPath,
+                      const std::string &archivePath);
+
+  // Where the archive copy of the snapshot at `backupPath` is kept.
+  static std::string getArchiveSnapshotPath(const std::string &backupPath);
+};
+
+#endif // BACKUP_JOB_HPP
@@ -0,0 +1,45 @@
+#ifndef CHART_RENDERER_HPP
+#define CHART_RENDERER_HPP
+
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "tickStore.hpp"
+
+#define CHART_WIDTH 640
+#define CHART_HEIGHT 320
+
+struct ChartColumn {
+  double low;
+  double high;
+  double close;
+};
+
+// Min/max bucketing: reduces the bars to at most `columns` evenly sized
+// buckets, keeping each bucket's extremes so spikes survive downsampling.
+std::vector<ChartColumn> downsampleBars(const std::vector<Bar> &bars,
+                                        size_t columns);
+
+// Draws the columns as a line chart and returns the encoded PNG bytes.
+std::string renderChartPng(const std::vector<ChartColumn> &columns, int width,
+                           int height);
+
+class ChartCache {
+private:
+  std::unordered_map<std::string, std::string> images;
+  std::deque<std::string> insertionOrder;
+  size_t maxEntries;
+  std::mutex cacheMutex;
+
+public:
+  ChartCache(size_t maxEntries);
+
+  bool get(const std::string &key, std::string &image);
+  void put(const std::string &key, const std::string &image);
+};
+
+#endif // CHART_RENDERER_HPP
@@ -0,0 +1,21 @@
+#ifndef COMMAND_REGISTRY_HPP
+#define COMMAND_REGISTRY_HPP
+
+#include <cstdint>
+#include <dpp/dpp.h>
+#include <string>
+#include <vector>
+
+// Canonical text form of everything Discord stores for a command, used to
+// compare local definitions against the registered ones.
+std::string commandSignature(const dpp::slashcommand &command);
+uint64_t hashCommands(const std::vector<dpp::slashcommand> &commands);
+
+// Registers the commands only if they differ from what Discord already has.
+// The hash of the last successful registration is cached at `hashPath` so an
+// unchanged restart makes no REST calls at all.
+void syncSlashCommands(dpp::cluster &bot,
+                       const std::vector<dpp::slashcommand> &commands,
+                       const std::string &hashPath);
+
+#endif // COMMAND_REGISTRY_HPP
@@ -0,0 +1,17 @@
+#ifndef COST_BASIS_BACKFILL_HPP
+#define COST_BASIS_BACKFILL_HPP
+
+#include <string>
+
+#include "databaseExecutor.hpp"
+
+#define BACKFILL_MAX_WORKERS 8
+
+// Fills in the average cost and realized P&L of every existing position by
+// replaying the transaction ledger. Users are split into contiguous ID ranges
+// that are replayed in parallel, each on its own read connection; the results
+// are written in one executor transaction. Does nothing once the schema
+// version records that the backfill has run.
+bool backfillCostBasis(DatabaseExecutor &dbExecutor, const std::string &dbPath);
+
+#endif // COST_BASIS_BACKFILL_HPP
@@ -0,0 +1,99 @@
+#ifndef DATABASE_EXECUTOR_HPP
+#define DATABASE_EXECUTOR_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include "databaseHandler.hpp"
+
+#define DB_QUEUE_CAPACITY 1024
+#define DB_BATCH_SIZE 32
+
+// Runs every database operation on one dedicated thread that owns the
+// connection. Operations are posted through a bounded lock-free queue;
+// posting blocks while the queue is full. Operations that are queued
+// together are run inside a single transaction, so a burst of commands
+// shares one commit; each task runs in its own savepoint inside it and is
+// rolled back alone if it throws. Nothing a task writes is durable until the
+// batch commits, so tasks reply through DatabaseHandler::afterCommit. Tasks
+// posted as non-transactional run alone, after the batch ahead of them has
+// committed. Tasks must not post to the executor themselves.
+class DatabaseExecutor {
+public:
+  using Task = std::function<void(DatabaseHandler &)>;
+
+private:
+  struct Slot {
+    std::atomic<size_t> sequence;
+    Task task;
+    bool transactional;
+  };
+
+  DatabaseHandler dbHandler;
+
+  std::unique_ptr<Slot[]> slots;
+  size_t mask;
+  std::atomic<size_t> enqueuePos{0};
+  size_t dequeuePos = 0;
+
+  std::atomic<bool> running{true};
+  std::atomic<bool> sleeping{false};
+  std::mutex wakeMutex;
+  std::condition_variable wakeCondition;
+  std::thread worker;
+
+  bool tryPush(Task &task, bool transactional);
+  bool tryPop(Task &task, bool &transactional);
+  void runTask(Task &task, bool isolated);
+  void run();
+
+public:
+  DatabaseExecutor(const std::string &dbPath,
+                   size_t capacity = DB_QUEUE_CAPACITY);
+  ~DatabaseExecutor();
+
+  DatabaseExecutor(const DatabaseExecutor &) = delete;
+  DatabaseExecutor &operator=(const DatabaseExecutor &) = delete;
+
+  void post(Task task, bool transactional = true);
+
+  template <typename Function>
+  auto submit(Function function, bool transactional = true)
+      -> std::future<decltype(function(std::declval<DatabaseHandler &>()))> {
+    using Result = decltype(function(std::declval<DatabaseHandler &>()));
+
+    auto promise = std::make_shared<std::promise<Result>>();
+    std::future<Result> future = promise->get_future();
+
+    post(
+        [promise, function](DatabaseHandler &db) mutable {
+          try {
+            if constexpr (std::is_void_v<Result>) {
+              function(db);
+              promise->set_value();
+            } else {
+              promise->set_value(function(db));
+            }
+          } catch (...) {
+            promise->set_exception(std::current_exception());
+            // Rethrown so the executor rolls back the task's writes.
+            throw;
+          }
+        },
+        transactional);
+
+    return future;
+  }
+};
+
+#endif // DATABASE_EXECUTOR_HPP
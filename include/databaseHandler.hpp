@@ -1,15 +1,58 @@
 #ifndef DATABASE_HANDLER_HPP
 #define DATABASE_HANDLER_HPP
 
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory_resource>
 #include <sqlite3.h>
 #include <string>
+#include <utility>
 #include <vector>
 
+#include "orderBook.hpp"
+
 #define STARTING_MONEY 5000.00
 
+// PRAGMA user_version values. Version 1 adds cost basis columns to
+// user_stocks; version 2 marks them as backfilled from the ledger.
+#define SCHEMA_VERSION_COST_BASIS 1
+#define SCHEMA_VERSION_COST_BASIS_BACKFILLED 2
+
+struct Position {
+  std::string stockName;
+  int quantity = 0;
+  // Quantity-weighted average price paid per share still held.
+  double averageCost = 0.0;
+  double realizedPnl = 0.0;
+};
+
+struct TransactionRecord {
+  int64_t transactionId = 0;
+  std::pmr::string stockName;
+  int quantity = 0;
+  // Total value of the trade, negative for purchases.
+  double value = 0.0;
+  std::pmr::string timestamp;
+};
+
+// Positions keyed by user ID and stock name.
+using PositionLedger =
+    std::map<std::pair<std::string, std::string>, Position>;
+
+// Applies a trade of `quantityChange` shares (negative for a sale) at `price`
+// per share. Sales realize the difference from the average cost and leave the
+// average cost of the remaining shares unchanged.
+void applyTrade(Position &position, int quantityChange, double price);
+
 class DatabaseHandler {
 private:
   sqlite3 *db;
+  int transactionDepth = 0;
+  bool archiveAttached = false;
+  // Callbacks waiting on the outermost commit, with the transaction depth
+  // they were registered at.
+  std::vector<std::pair<int, std::function<void(bool)>>> commitCallbacks;
   // std::mutex connectionMutex;
 
   bool insertUser(const std::string &userId);
@@ -23,21 +66,85 @@ public:
   ~DatabaseHandler();
 
   bool createTables();
+  int getSchemaVersion();
+  bool setSchemaVersion(int version);
+
+  // The raw connection, for SQLite APIs that work on whole databases such as
+  // online backup. Only use it from the thread that owns this handler.
+  sqlite3 *getConnection();
+
+  // The outermost transaction takes the write lock up front so concurrent
+  // bot processes serialize instead of failing to upgrade a read lock.
+  // Nested transactions are savepoints.
+  bool beginTransaction();
+  bool commitTransaction();
+  bool rollbackTransaction();
+  // Runs `callback` with true once the writes made so far are committed, or
+  // with false if the transaction they belong to is rolled back. Outside a
+  // transaction the writes are already committed and it runs at once.
+  void afterCommit(std::function<void(bool committed)> callback);
 
   bool updateUserBalance(const std::string &userId, double balanceChange);
+  // `price` is the price per share the change was traded at.
   bool updateUserStock(const std::string &userId, const std::string &stockName,
-                       int quantityChange);
+                       int quantityChange, double price);
   bool updateTransactionsHistory(const std::string &userId,
                                  const std::string &stockName, int quantity,
                                  double price, const std::string &timestamp);
 
-  std::vector<std::pair<std::string, int>>
-  getUserStocks(const std::string &userId);
+  // Read APIs that return rows allocate them from `resource`, so a command
+  // can materialize them in its own arena.
+  std::pmr::vector<Position> getUserStocks(
+      const std::string &userId,
+      std::pmr::memory_resource *resource = std::pmr::get_default_resource());
   double getUserBalance(const std::string &userId);
   int getUserStockQuantity(const std::string &userId,
                            const std::string &stockName);
-  std::vector<std::vector<std::string>>
-  getUserHistory(const std::string &userId);
+  double getUserRealizedPnl(const std::string &userId);
+
+  // Keyset pages. Open positions are ordered by stock name and returned up to
+  // `limit` after `cursor`, or before it when `forward` is false. History is
+  // ordered newest first and returned up to `limit` rows older than `cursor`,
+  // or newer than it when `older` is false; it continues into the archive
+  // only once the hot ledger runs out.
+  std::pmr::vector<Position> getUserStocksPage(
+      const std::string &userId, const std::string &cursor, bool forward,
+      int limit,
+      std::pmr::memory_resource *resource = std::pmr::get_default_resource());
+  std::pmr::vector<TransactionRecord> getUserHistoryPage(
+      const std::string &userId, int64_t cursor, bool older, int limit,
+      std::pmr::memory_resource *resource = std::pmr::get_default_resource());
+
+  // Cost basis backfill. The ledger stores each trade's total value, negative
+  // for purchases.
+  std::vector<std::string> getLedgerUserIds();
+  int64_t getLastTransactionId();
+  // Replays ledger rows with IDs in (afterId, throughId] into `positions`.
+  // An empty `lastUserId` leaves the user range open at the top.
+  bool replayTransactions(PositionLedger &positions,
+                          const std::string &firstUserId,
+                          const std::string &lastUserId, int64_t afterId,
+                          int64_t throughId);
+  bool writeCostBasis(const PositionLedger &positions);
+
+  // Ledger tiering. Old transactions move to an attached archive database and
+  // are summed per user and stock into user_rollups; history reads span both.
+  // Attaching must happen outside a transaction.
+  bool attachArchive(const std::string &archivePath);
+  bool isArchiveAttached() const;
+  // Highest transaction ID such that it and every ID below it were recorded
+  // before `timestamp`. Rows copied in from another shard get new IDs with
+  // their original dates, so the ledger is not strictly ordered by date.
+  int64_t getLastTransactionIdBefore(const std::string &timestamp);
+  // Moves up to `limit` of the oldest transactions with IDs up to `throughId`
+  // to the archive. Returns the number moved, or -1 on failure. Commits its
+  // own transactions, so it must not run inside one.
+  int archiveTransactions(int64_t throughId, int limit);
+
+  int64_t insertOrder(const Order &order, const std::string &timestamp);
+  bool deleteOrder(int64_t orderId);
+  std::vector<Order> getOpenOrders(int64_t afterOrderId);
+  std::vector<Order> getUserOrders(const std::string &userId);
 };
 
 #endif // DATABASE_HANDLER_HPP
@@ -0,0 +1,74 @@
+#ifndef ORDER_BOOK_HPP
+#define ORDER_BOOK_HPP
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+enum class OrderSide { Buy, Sell };
+enum class OrderType { Limit, Stop };
+
+struct Order {
+  int64_t orderId = -1;
+  std::string userId;
+  std::string stockName;
+  OrderSide side = OrderSide::Buy;
+  OrderType type = OrderType::Limit;
+  int quantity = 0;
+  double triggerPrice = 0.0;
+};
+
+class OrderBook {
+private:
+  // Orders that trigger once the price falls to or below their trigger price
+  // (buy limits and sell stops), highest trigger first.
+  using FallingBook = std::multimap<double, Order, std::greater<double>>;
+  // Orders that trigger once the price rises to or above their trigger price
+  // (sell limits and buy stops), lowest trigger first.
+  using RisingBook = std::multimap<double, Order>;
+
+  struct SymbolBook {
+    FallingBook falling;
+    RisingBook rising;
+  };
+
+  struct OrderLocation {
+    std::string stockName;
+    bool falling;
+    FallingBook::iterator fallingIt;
+    RisingBook::iterator risingIt;
+  };
+
+  std::unordered_map<std::string, SymbolBook> books;
+  std::unordered_map<int64_t, OrderLocation> locations;
+  int64_t polledOrderId = 0;
+  std::mutex bookMutex;
+
+  static bool triggersOnFall(const Order &order);
+
+public:
+  // Orders already in the book are ignored.
+  void addOrder(const Order &order);
+  // Adds orders read from the database and advances the polled order ID past
+  // them. addOrder leaves it alone: an order this process just placed may
+  // have a higher ID than one another process committed before it that has
+  // not been polled yet.
+  void addPolledOrders(const std::vector<Order> &orders);
+  bool removeOrder(int64_t orderId);
+
+  // Removes and returns every resting order for the symbol crossed by the
+  // given price. Only the crossed orders are visited.
+  std::vector<Order> onPrice(const std::string &stockName, double price);
+
+  std::vector<std::string> getSymbols();
+  // Highest order ID read from the database, used to pick up orders placed
+  // elsewhere.
+  int64_t getPolledOrderId();
+  size_t size();
+};
+
+#endif // ORDER_BOOK_HPP
@@ -0,0 +1,78 @@
+#ifndef QUOTE_CACHE_HPP
+#define QUOTE_CACHE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "upstreamClient.hpp"
+
+#define QUOTE_CACHE_SLOTS 4096
+#define QUOTE_SYMBOL_LENGTH 16
+#define QUOTE_TTL_MILLIS 5000
+// Outlasts the claimant's whole upstream call, so the processes waiting on it
+// do not give up and fetch the same symbol themselves.
+#define QUOTE_CLAIM_MILLIS (UPSTREAM_DEADLINE_MILLIS + 1000)
+// A slot whose quote is this old may be taken over by another symbol.
+#define QUOTE_EVICT_MILLIS 60000
+// A writer holding an entry this long is taken to have died mid-write.
+#define QUOTE_STUCK_MILLIS 1000
+
+struct Quote {
+  double price;
+  double change;
+  double percentChange;
+};
+
+// Quote table in POSIX shared memory, shared by every bot process on the
+// host. Entries are seqlocked so readers never block writers, and a
+// per-symbol claim makes sure only one process fetches an expired quote
+// while the others wait for its result. Slots whose quote has gone unused
+// for QUOTE_EVICT_MILLIS, or that never got one, are reused for new symbols.
+class QuoteCache {
+private:
+  struct Entry {
+    std::atomic<uint32_t> sequence;
+    std::atomic<int64_t> claimedAt;
+    std::atomic<int64_t> lockedAt;
+    char symbol[QUOTE_SYMBOL_LENGTH];
+    Quote quote;
+    int64_t fetchedAt;
+  };
+
+  struct Table {
+    std::atomic<uint32_t> version;
+    std::atomic<uint64_t> upstreamFetches;
+    Entry entries[QUOTE_CACHE_SLOTS];
+  };
+
+  std::string name;
+  Table *table = nullptr;
+
+  bool waitForWriter(Entry &entry, uint32_t &sequence);
+  uint32_t lockEntry(Entry &entry);
+  Entry *findEntry(const std::string &symbol, bool create);
+  bool takeOverEntry(Entry &entry, const std::string &evicted,
+                     const std::string &symbol);
+  bool readEntry(Entry &entry, const std::string &symbol, Quote &quote,
+                 int64_t &fetchedAt);
+
+public:
+  QuoteCache(const std::string &name);
+  ~QuoteCache();
+
+  QuoteCache(const QuoteCache &) = delete;
+  QuoteCache &operator=(const QuoteCache &) = delete;
+
+  bool isOpen() const;
+
+  // Returns a quote no older than the TTL, calling `fetch` at most once per
+  // host when it has expired. `fetch` returns false if the upstream failed.
+  bool getQuote(const std::string &symbol, Quote &quote,
+                const std::function<bool(Quote &)> &fetch);
+
+  uint64_t getUpstreamFetches() const;
+};
+
+#endif // QUOTE_CACHE_HPP
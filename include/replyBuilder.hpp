@@ -0,0 +1,37 @@
+#ifndef REPLY_BUILDER_HPP
+#define REPLY_BUILDER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <string>
+
+#define REPLY_ARENA_BYTES 16384
+
+// Monotonic arena for everything one command allocates while reading rows and
+// building its reply. The first REPLY_ARENA_BYTES come from inline storage;
+// beyond that it falls back to the heap. Everything is freed at once when the
+// arena goes out of scope.
+class ReplyArena {
+private:
+  alignas(std::max_align_t) char buffer[REPLY_ARENA_BYTES];
+  std::pmr::monotonic_buffer_resource resource;
+
+public:
+  ReplyArena();
+
+  ReplyArena(const ReplyArena &) = delete;
+  ReplyArena &operator=(const ReplyArena &) = delete;
+
+  std::pmr::memory_resource *get();
+};
+
+// Formatting helpers that append in place instead of going through streams.
+// Integer parts are grouped by thousands with commas.
+void appendInteger(std::pmr::string &out, int64_t value);
+void appendFixed(std::pmr::string &out, double value, int precision);
+// "1,234.50" for a money amount, "+$1,234.50" or "-$1,234.50" when signed.
+void appendMoney(std::pmr::string &out, double value);
+void appendSignedMoney(std::pmr::string &out, double value);
+
+#endif // REPLY_BUILDER_HPP
@@ -2,10 +2,41 @@
 #define STOCK_RETRIEVER_H
 
 #include <cstddef>
+#include <functional>
 #include <string>
+#include <vector>
 
+#include "quoteCache.hpp"
+#include "symbolDirectory.hpp"
+#include "upstreamClient.hpp"
+
+// How long the last quote seen for a symbol may stand in for a live one.
+#define STALE_QUOTE_MAX_MILLIS (15 * 60 * 1000)
+
+// Quotes are served from the shared cache when one is set.
+void setQuoteCache(QuoteCache *cache);
+// Once a loaded directory is set, symbols missing from it fail without a
+// request.
+void setSymbolDirectory(SymbolDirectory *directory);
+
+// Called with every price successfully retrieved by getStockPrice.
+void setPriceListener(
+    std::function<void(const std::string &, double)> listener);
+
+// Only live quotes are returned unless `stale` is given. Then, while Finnhub
+// is failing, the last quote this process saw within STALE_QUOTE_MAX_MILLIS
+// is returned instead and `stale` is set. Only display commands pass it;
+// prices used for trades are always live.
+bool getQuote(const std::string &symbol, Quote &quote,
+              bool *stale = nullptr);
 double getStockPrice(const std::string &symbol);
 double getChange(const std::string &symbol);
 double getPercentChange(const std::string &symbol);
 
+// Every symbol listed on `exchange`, e.g. "US".
+bool getExchangeSymbols(const std::string &exchange,
+                        std::vector<std::string> &symbols);
+
+UpstreamStats getUpstreamStats();
+
 #endif // STOCK_RETRIEVER_H
@@ -0,0 +1,115 @@
+#ifndef STORAGE_ROUTER_HPP
+#define STORAGE_ROUTER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <sqlite3.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "databaseExecutor.hpp"
+#include "orderBook.hpp"
+
+// One database file with its own executor, and so its own writer and
+// connection, plus the book of the orders stored in it.
+struct StorageShard {
+  size_t index = 0;
+  std::string dbPath;
+  std::string archivePath;
+  std::unique_ptr<DatabaseExecutor> executor;
+  OrderBook orderBook;
+};
+
+// Advisory lock on a shard's "-lock" file, next to its database. Bot
+// processes share it; rebalancing and restoring need it to themselves, so
+// they refuse to run while any bot process has the shard open.
+class ShardLock {
+private:
+  int fd = -1;
+
+public:
+  ShardLock(const std::string &dbPath, bool exclusive);
+  ~ShardLock();
+
+  ShardLock(const ShardLock &) = delete;
+  ShardLock &operator=(const ShardLock &) = delete;
+
+  bool isHeld() const;
+};
+
+// Splits storage into database shards by guild, so guilds on different shards
+// never wait on each other's write lock. Every guild is its own economy:
+// accounts are keyed "<guild>:<user>" and each guild lives in exactly one
+// shard. Direct messages (guild 0) keep bare user IDs on shard 0, which is
+// the original database file. A guild is placed by hash the first time it is
+// seen and the placement is recorded in a catalog database, so changing the
+// shard count only affects new guilds. The catalog is written on shard 0's
+// executor, so placing a guild never makes a command wait on it. Accounts
+// from before sharding, which are keyed by bare user ID too, stay with direct
+// messages until they are adopted by a guild.
+class StorageRouter {
+private:
+  std::vector<std::unique_ptr<StorageShard>> shards;
+  std::vector<std::unique_ptr<ShardLock>> locks;
+  // Guards the catalog connection; placementsMutex guards the map, so
+  // lookups never wait on a catalog write.
+  std::mutex catalogMutex;
+  sqlite3 *catalog = nullptr;
+  std::mutex placementsMutex;
+  std::unordered_map<uint64_t, size_t> placements;
+
+  void recordPlacement(uint64_t guildId, size_t index);
+  bool setPlacement(uint64_t guildId, size_t index);
+  int64_t getGuildActivity(StorageShard &shard, uint64_t guildId);
+  bool copyGuild(StorageShard &source, StorageShard &target, uint64_t guildId);
+  bool removeGuild(StorageShard &shard, uint64_t guildId);
+
+public:
+  // Shard 0 uses `dbPath` and `archivePath` as given; shard N inserts "-N"
+  // before their extensions.
+  StorageRouter(const std::string &catalogPath, const std::string &dbPath,
+                const std::string &archivePath, size_t shardCount);
+  ~StorageRouter();
+
+  StorageRouter(const StorageRouter &) = delete;
+  StorageRouter &operator=(const StorageRouter &) = delete;
+
+  // False if the catalog could not be opened or places guilds on shards
+  // beyond the configured count.
+  bool isOpen() const;
+
+  // Locks every shard, shared for a bot process or exclusively for the
+  // rebalancing tools. False if another process holds a conflicting lock.
+  bool lockShards(bool exclusive);
+
+  size_t size() const;
+  StorageShard &getShard(size_t index);
+  StorageShard &getShardForGuild(uint64_t guildId);
+
+  // Guilds the catalog places on a shard.
+  std::vector<uint64_t> getGuilds(size_t index);
+
+  // Rebalancing. These copy a guild's rows into the target shard, repoint
+  // the catalog and then delete the guild from every other shard, so an
+  // interrupted move can simply be run again, even once the catalog already
+  // points at the target. Archived transactions stay archived on the target.
+  // Only run them with the shards locked exclusively.
+  bool moveGuild(uint64_t guildId, size_t toIndex);
+  // Moves every other guild on `fromIndex`, by trading activity, to
+  // `toIndex`.
+  bool splitShard(size_t fromIndex, size_t toIndex);
+
+  // Hands every bare-user-ID account on shard 0, made before accounts were
+  // kept per guild, to `guildId`, which must be on shard 0. Users who already
+  // have an account in the guild keep both. Can only be done once; the
+  // accounts then no longer answer direct messages.
+  bool adoptLegacyAccounts(uint64_t guildId);
+
+  static std::string getAccountId(uint64_t guildId, uint64_t userId);
+  static std::string getShardPath(const std::string &path, size_t index);
+};
+
+#endif // STORAGE_ROUTER_HPP
@@ -0,0 +1,51 @@
+#ifndef SYMBOL_DIRECTORY_HPP
+#define SYMBOL_DIRECTORY_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#define SYMBOL_COMPLETION_LIMIT 25
+
+// Every ticker listed on the exchange, kept as one sorted array so exact
+// lookups are a binary search and completions are the run of entries that
+// share a prefix. The list is cached in a file with one symbol per line.
+// Readers take the current snapshot without locking; a refresh builds a new
+// one and swaps it in.
+class SymbolDirectory {
+private:
+  std::string cachePath;
+  std::shared_ptr<const std::vector<std::string>> symbols;
+  std::mutex reloadMutex;
+  // Inode and modification time in nanoseconds of the file last loaded.
+  std::pair<uint64_t, int64_t> loadedVersion;
+
+  std::shared_ptr<const std::vector<std::string>> snapshot() const;
+  void publish(std::vector<std::string> sorted);
+
+public:
+  SymbolDirectory(const std::string &cachePath);
+
+  SymbolDirectory(const SymbolDirectory &) = delete;
+  SymbolDirectory &operator=(const SymbolDirectory &) = delete;
+
+  // Loads the cache file if it changed since the last load.
+  bool reload();
+  // Replaces the directory and rewrites the cache file.
+  bool store(std::vector<std::string> fetched);
+  // Seconds since the cache file was written, or -1 if there is none.
+  int64_t getCacheAgeSeconds() const;
+
+  // An empty directory could not be loaded, and knows nothing to reject.
+  bool isLoaded() const;
+  bool contains(const std::string &symbol) const;
+  std::vector<std::string>
+  complete(const std::string &prefix,
+           size_t limit = SYMBOL_COMPLETION_LIMIT) const;
+};
+
+#endif // SYMBOL_DIRECTORY_HPP
@@ -0,0 +1,87 @@
+#ifndef TICK_STORE_HPP
+#define TICK_STORE_HPP
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Symbols whose current segment is kept open for appending, two descriptors
+// each. The least recently appended one is closed to make room.
+#define TICK_OPEN_SEGMENTS_MAX 256
+
+struct Tick {
+  int64_t timestamp;
+  double price;
+};
+
+struct Bar {
+  int64_t timestamp;
+  double open;
+  double high;
+  double low;
+  double close;
+};
+
+enum class BarInterval : int64_t {
+  OneMinute = 60 * 1000,
+  FiveMinutes = 5 * 60 * 1000,
+  OneHour = 60 * 60 * 1000,
+  OneDay = 24 * 60 * 60 * 1000
+};
+
+// Append-only store of per-symbol price ticks. Each symbol has a directory of
+// per-day segments: a `.ts` file of int64 millisecond timestamps and a `.px`
+// file of double prices, written as parallel fixed-width arrays and
+// memory-mapped on read. Compacted days are kept as a `.bar` file of
+// one-minute bars instead; readers skip raw ticks the bars already cover, so
+// a day caught between the two is not read twice.
+class TickStore {
+private:
+  struct OpenSegment {
+    int64_t day = -1;
+    int timestampFd = -1;
+    int priceFd = -1;
+    int64_t lastTimestamp = 0;
+    std::list<std::string>::iterator recent;
+  };
+
+  std::string rootPath;
+  std::unordered_map<std::string, OpenSegment> openSegments;
+  // Symbols in openSegments, most recently appended first.
+  std::list<std::string> recentSymbols;
+  std::mutex appendMutex;
+
+  std::string segmentPath(const std::string &symbol, int64_t day,
+                          const std::string &extension);
+
+  static void closeSegment(OpenSegment &segment);
+  static bool alignColumns(OpenSegment &segment);
+
+  template <typename Callback>
+  void forEachBar(const std::string &symbol, int64_t from, int64_t to,
+                  Callback &&callback);
+  bool compactSegment(const std::string &symbol, int64_t day);
+
+public:
+  TickStore(const std::string &rootPath);
+  ~TickStore();
+
+  bool appendTick(const std::string &symbol, int64_t timestamp, double price);
+
+  // Ticks and bars in [from, to), in timestamp order. Days that have been
+  // compacted yield one tick per minute at the bar's close.
+  std::vector<Tick> getTicks(const std::string &symbol, int64_t from,
+                             int64_t to);
+  std::vector<Bar> getBars(const std::string &symbol, int64_t from, int64_t to,
+                           BarInterval interval);
+
+  // Rewrites raw segments for days before `before` as one-minute bars.
+  bool compactSegments(int64_t before);
+  // Deletes every segment for days before `before`.
+  bool removeSegments(int64_t before);
+};
+
+#endif // TICK_STORE_HPP
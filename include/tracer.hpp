@@ -0,0 +1,77 @@
+#ifndef TRACER_HPP
+#define TRACER_HPP
+
+#include <cstdint>
+#include <string>
+
+#define TRACE_RING_EVENTS 8192
+#define TRACE_SAMPLE_RATE 0.01
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+// Records the enclosing scope as a span of the current interaction. `name`
+// must outlive the process, e.g. a string literal.
+#define TRACE_SCOPE(name) TraceSpan TRACE_CONCAT(traceSpan, __LINE__)(name)
+
+// Spans are only recorded for sampled interactions. Each thread writes its
+// spans into its own fixed ring, so recording takes no locks; the oldest
+// spans are overwritten once a ring is full. Unsampled scopes cost one
+// thread-local read.
+void setTraceSampleRate(double rate);
+void setTraceThreadName(const std::string &name);
+
+int64_t traceNow();
+// The trace of the interaction this thread is working on, or 0 if it is not
+// sampled.
+uint64_t currentTraceId();
+void recordSpan(const char *name, int64_t startNanos, int64_t endNanos);
+
+// Writes every span still held in the rings as Chrome trace-event JSON, which
+// chrome://tracing and Perfetto open.
+bool writeChromeTrace(const std::string &path);
+
+class TraceSpan {
+private:
+  const char *name;
+  int64_t start = 0;
+
+public:
+  TraceSpan(const char *name);
+  ~TraceSpan();
+
+  TraceSpan(const TraceSpan &) = delete;
+  TraceSpan &operator=(const TraceSpan &) = delete;
+};
+
+// Makes `traceId` the current trace on this thread until destroyed, so work
+// handed to another thread can continue the interaction that queued it.
+class TraceContext {
+private:
+  uint64_t previous;
+
+public:
+  TraceContext(uint64_t traceId);
+  ~TraceContext();
+
+  TraceContext(const TraceContext &) = delete;
+  TraceContext &operator=(const TraceContext &) = delete;
+};
+
+// Root of one interaction. Decides whether it is sampled and, if so, records
+// a span named after it covering its lifetime.
+class TraceInteraction {
+private:
+  uint64_t traceId = 0;
+  uint64_t previous = 0;
+  const char *name = nullptr;
+  int64_t start = 0;
+
+public:
+  TraceInteraction(const std::string &name);
+  ~TraceInteraction();
+
+  TraceInteraction(const TraceInteraction &) = delete;
+  TraceInteraction &operator=(const TraceInteraction &) = delete;
+};
+
+#endif // TRACER_HPP
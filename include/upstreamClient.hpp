@@ -0,0 +1,79 @@
+#ifndef UPSTREAM_CLIENT_HPP
+#define UPSTREAM_CLIENT_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define UPSTREAM_CONNECT_TIMEOUT_MILLIS 1000
+#define UPSTREAM_REQUEST_TIMEOUT_MILLIS 2000
+#define UPSTREAM_DEADLINE_MILLIS 5000
+#define UPSTREAM_MAX_ATTEMPTS 3
+#define UPSTREAM_BACKOFF_BASE_MILLIS 100
+#define UPSTREAM_LATENCY_SAMPLES 128
+#define UPSTREAM_HEDGE_MIN_SAMPLES 20
+#define UPSTREAM_HEDGE_MIN_MILLIS 50
+#define UPSTREAM_HEDGE_DEFAULT_MILLIS 500
+#define UPSTREAM_BREAKER_FAILURES 5
+#define UPSTREAM_BREAKER_COOLDOWN_MILLIS 30000
+
+struct UpstreamStats {
+  uint64_t requests = 0;
+  uint64_t retries = 0;
+  uint64_t hedges = 0;
+  // Hedges whose response arrived before the original request's.
+  uint64_t hedgeWins = 0;
+  uint64_t rejected = 0;
+};
+
+// HTTP GETs against a flaky upstream within a deadline. Each attempt gets
+// its own timeout, and if it has not answered by the 95th percentile of
+// recent latencies a second, hedged request races it. Failed attempts are
+// retried with jittered exponential backoff. After enough consecutive
+// failed calls the circuit breaker opens and requests fail at once until the
+// cooldown ends, after which a single probe decides whether it closes again.
+class UpstreamClient {
+private:
+  std::mutex mutex;
+  std::vector<int64_t> latencies;
+  size_t nextLatency = 0;
+  int consecutiveFailures = 0;
+  // Zero while the breaker is closed.
+  int64_t openUntil = 0;
+  bool probing = false;
+
+  std::atomic<uint64_t> requests{0};
+  std::atomic<uint64_t> retries{0};
+  std::atomic<uint64_t> hedges{0};
+  std::atomic<uint64_t> hedgeWins{0};
+  std::atomic<uint64_t> rejected{0};
+
+  bool allowRequest();
+  void recordSuccess(int64_t latencyMillis);
+  // The upstream answered, but with an error of the caller's making.
+  void recordAnswer();
+  void recordFailure();
+  int64_t getHedgeDelayMillis();
+  // One attempt, hedged if it runs long. Returns false on a timeout,
+  // connection error or non-200 status; `retryable` is cleared for client
+  // errors that another attempt would not fix.
+  bool attempt(const std::string &url, int64_t deadline, std::string &body,
+               bool &retryable);
+
+public:
+  UpstreamClient();
+
+  UpstreamClient(const UpstreamClient &) = delete;
+  UpstreamClient &operator=(const UpstreamClient &) = delete;
+
+  // Returns false when the breaker is open or no attempt succeeded before
+  // the deadline.
+  bool get(const std::string &url, std::string &body);
+
+  bool isOpen();
+  UpstreamStats getStats() const;
+};
+
+#endif // UPSTREAM_CLIENT_HPP
@@ -0,0 +1,336 @@
+#include "../include/backupJob.hpp"
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <sqlite3.h>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+namespace {
+
+const std::string snapshotPrefix = "gameData-";
+const std::string archiveSnapshotPrefix = "archive-";
+const std::string snapshotExtension = ".db";
+
+std::string snapshotName() {
+  std::time_t currentTime =
+      std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+  std::tm localTime;
+  localtime_r(&currentTime, &localTime);
+
+  std::stringstream ss;
+  ss << snapshotPrefix << std::put_time(&localTime, "%Y%m%d-%H%M%S")
+     << snapshotExtension;
+
+  return ss.str();
+}
+
+struct BackupStep {
+  int result;
+  int remaining;
+  int64_t micros;
+};
+
+} // namespace
+
+BackupJob::BackupJob(DatabaseExecutor &dbExecutor,
+                     const std::string &backupDir, size_t keepCount)
+    : dbExecutor(dbExecutor), backupDir(backupDir), keepCount(keepCount) {}
+
+BackupJob::~BackupJob() {
+  stopping.store(true);
+
+  if (worker.joinable()) {
+    worker.join();
+  }
+}
+
+bool BackupJob::start(std::function<void(const BackupResult &)> done) {
+  bool idle = false;
+
+  if (!running.compare_exchange_strong(idle, true)) {
+    return false;
+  }
+
+  if (worker.joinable()) {
+    worker.join();
+  }
+
+  worker = std::thread([this, done]() {
+    BackupResult result = run();
+    done(result);
+    running.store(false);
+  });
+
+  return true;
+}
+
+// Copies one schema of the executor's connection into a new file at `path`.
+int BackupJob::copySchema(const char *schema, const std::string &path,
+                          std::chrono::steady_clock::time_point deadline,
+                          BackupResult &result) {
+  sqlite3 *destination;
+
+  if (sqlite3_open(path.c_str(), &destination) != SQLITE_OK) {
+    std::cerr << "Failed to open backup file: " << path << std::endl;
+    sqlite3_close(destination);
+    return SQLITE_CANTOPEN;
+  }
+
+  sqlite3_backup *backup =
+      dbExecutor
+          .submit(
+              [destination, schema](DatabaseHandler &dbHandler) {
+                return sqlite3_backup_init(destination, "main",
+                                           dbHandler.getConnection(), schema);
+              },
+              false)
+          .get();
+
+  if (!backup) {
+    std::cerr << "Failed to start backup: " << sqlite3_errmsg(destination)
+              << std::endl;
+    sqlite3_close(destination);
+    return SQLITE_ERROR;
+  }
+
+  int rc = SQLITE_OK;
+  int pages = BACKUP_STEP_PAGES;
+  int lastRemaining = -1;
+  int restarts = 0;
+
+  while (!stopping.load()) {
+    if (std::chrono::steady_clock::now() >= deadline) {
+      std::cerr << "Backup did not finish within " << BACKUP_BUDGET_MILLIS
+                << " ms." << std::endl;
+      rc = SQLITE_ABORT;
+      break;
+    }
+
+    // Steps must run outside the executor's batch transaction, which holds
+    // the write lock the step would otherwise wait on.
+    BackupStep step =
+        dbExecutor
+            .submit(
+                [backup, pages](DatabaseHandler & /*dbHandler*/) {
+                  auto stepStart = std::chrono::steady_clock::now();
+                  int stepResult = sqlite3_backup_step(backup, pages);
+
+                  return BackupStep{
+                      stepResult, sqlite3_backup_remaining(backup),
+                      static_cast<int64_t>(
+                          std::chrono::duration_cast<
+                              std::chrono::microseconds>(
+                              std::chrono::steady_clock::now() - stepStart)
+                              .count())};
+                },
+                false)
+            .get();
+
+    rc = step.result;
+    result.steps++;
+    result.maxStallMicros = std::max(result.maxStallMicros, step.micros);
+
+    if (rc == SQLITE_DONE ||
+        (rc != SQLITE_OK && rc != SQLITE_BUSY && rc != SQLITE_LOCKED)) {
+      break;
+    }
+
+    // A step that leaves no fewer pages to go than the last one started
+    // over.
+    if (rc == SQLITE_OK && lastRemaining >= 0 &&
+        step.remaining >= lastRemaining) {
+      result.restarts++;
+
+      if (++restarts >= BACKUP_MAX_RESTARTS) {
+        pages = -1;
+      }
+    }
+
+    lastRemaining = step.remaining;
+
+    std::this_thread::sleep_for(
+        std::chrono::milliseconds(BACKUP_STEP_PAUSE_MILLIS));
+  }
+
+  dbExecutor
+      .submit(
+          [backup](DatabaseHandler & /*dbHandler*/) {
+            sqlite3_backup_finish(backup);
+          },
+          false)
+      .wait();
+  sqlite3_close(destination);
+
+  return rc;
+}
+
+BackupResult BackupJob::run() {
+  auto start = std::chrono::steady_clock::now();
+  BackupResult result;
+
+  std::error_code ec;
+  std::filesystem::create_directories(backupDir, ec);
+
+  std::string path = backupDir + "/" + snapshotName();
+  std::string archivePath = getArchiveSnapshotPath(path);
+  std::string partialPath = path + ".partial";
+  std::string archivePartialPath = archivePath + ".partial";
+  std::filesystem::remove(partialPath, ec);
+  std::filesystem::remove(archivePartialPath, ec);
+
+  bool archiveAttached =
+      dbExecutor
+          .submit(
+              [](DatabaseHandler &dbHandler) {
+                return dbHandler.isArchiveAttached();
+              },
+              false)
+          .get();
+
+  // The archive is copied after the live database. Rows archived in between
+  // are then in both snapshots rather than neither, and the archive job
+  // drops the live copies again after a restore.
+  auto deadline = start + std::chrono::milliseconds(BACKUP_BUDGET_MILLIS);
+  int rc = copySchema("main", partialPath, deadline, result);
+
+  if (rc == SQLITE_DONE && archiveAttached) {
+    rc = copySchema("archive", archivePartialPath, deadline, result);
+  }
+
+  if (rc == SQLITE_DONE && archiveAttached) {
+    std::filesystem::rename(archivePartialPath, archivePath, ec);
+  }
+
+  if (rc == SQLITE_DONE && !ec) {
+    std::filesystem::rename(partialPath, path, ec);
+  } else if (rc != SQLITE_DONE) {
+    std::cerr << "Backup failed: " << sqlite3_errstr(rc) << std::endl;
+  }
+
+  if (rc != SQLITE_DONE || ec) {
+    std::filesystem::remove(partialPath, ec);
+    std::filesystem::remove(archivePartialPath, ec);
+    std::filesystem::remove(archivePath, ec);
+  } else {
+    result.success = true;
+    result.path = path;
+    rotate();
+  }
+
+  result.durationMillis =
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::steady_clock::now() - start)
+          .count();
+
+  return result;
+}
+
+void BackupJob::rotate() {
+  std::vector<std::filesystem::path> snapshots;
+  std::error_code ec;
+
+  for (const auto &entry :
+       std::filesystem::directory_iterator(backupDir, ec)) {
+    std::string name = entry.path().filename().string();
+
+    if (name.size() > snapshotPrefix.size() + snapshotExtension.size() &&
+        name.compare(0, snapshotPrefix.size(), snapshotPrefix) == 0 &&
+        name.compare(name.size() - snapshotExtension.size(),
+                     snapshotExtension.size(), snapshotExtension) == 0) {
+      snapshots.push_back(entry.path());
+    }
+  }
+
+  if (snapshots.size() <= keepCount) {
+    return;
+  }
+
+  // Snapshot names sort oldest first.
+  std::sort(snapshots.begin(), snapshots.end());
+
+  for (size_t i = 0; i + keepCount < snapshots.size(); i++) {
+    if (!std::filesystem::remove(snapshots[i], ec)) {
+      std::cerr << "Failed to remove old backup: " << snapshots[i]
+                << std::endl;
+    }
+
+    std::filesystem::remove(getArchiveSnapshotPath(snapshots[i].string()),
+                            ec);
+  }
+}
+
+std::string BackupJob::getArchiveSnapshotPath(const std::string &backupPath) {
+  std::filesystem::path path(backupPath);
+  std::string name = path.filename().string();
+
+  if (name.compare(0, snapshotPrefix.size(), snapshotPrefix) == 0) {
+    name = archiveSnapshotPrefix + name.substr(snapshotPrefix.size());
+  } else {
+    name = archiveSnapshotPrefix + name;
+  }
+
+  return path.replace_filename(name).string();
+}
+
+bool BackupJob::restore(const std::string &backupPath,
+                        const std::string &dbPath,
+                        const std::string &archivePath) {
+  if (!restoreFile(backupPath, dbPath)) {
+    return false;
+  }
+
+  // Snapshots taken before the archive existed have no archive copy; the
+  // archive is then left as it is.
+  std::string archiveBackupPath = getArchiveSnapshotPath(backupPath);
+  std::error_code ec;
+
+  if (!std::filesystem::exists(archiveBackupPath, ec)) {
+    return true;
+  }
+
+  return restoreFile(archiveBackupPath, archivePath);
+}
+
+bool BackupJob::restoreFile(const std::string &backupPath,
+                            const std::string &dbPath) {
+  sqlite3 *source;
+  sqlite3 *destination;
+
+  if (sqlite3_open_v2(backupPath.c_str(), &source, SQLITE_OPEN_READONLY,
+                      nullptr) != SQLITE_OK) {
+    std::cerr << "Failed to open backup file: " << backupPath << std::endl;
+    sqlite3_close(source);
+    return false;
+  }
+
+  if (sqlite3_open(dbPath.c_str(), &destination) != SQLITE_OK) {
+    std::cerr << "Failed to open database file." << std::endl;
+    sqlite3_close(destination);
+    sqlite3_close(source);
+    return false;
+  }
+
+  sqlite3_backup *backup =
+      sqlite3_backup_init(destination, "main", source, "main");
+  int rc = SQLITE_ERROR;
+
+  if (backup) {
+    rc = sqlite3_backup_step(backup, -1);
+    sqlite3_backup_finish(backup);
+  }
+
+  if (rc != SQLITE_DONE) {
+    std::cerr << "Failed to restore backup: " << sqlite3_errmsg(destination)
+              << std::endl;
+  }
+
+  sqlite3_close(destination);
+  sqlite3_close(source);
+
+  return rc == SQLITE_DONE;
+}
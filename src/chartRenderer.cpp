@@ -0,0 +1,348 @@
+#include "../include/chartRenderer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <zlib.h>
+
+namespace {
+
+enum PaletteIndex : uint8_t {
+  Background = 0,
+  Grid = 1,
+  Rising = 2,
+  Falling = 3,
+  RisingFill = 4,
+  FallingFill = 5,
+  Text = 6
+};
+
+const uint8_t palette[][3] = {
+    {0x2b, 0x2d, 0x31}, {0x3f, 0x41, 0x47}, {0x23, 0xa5, 0x5a},
+    {0xf2, 0x3f, 0x43}, {0x27, 0x43, 0x35}, {0x4b, 0x2e, 0x33},
+    {0xdb, 0xde, 0xe1}};
+
+// 3x5 glyphs, one row per byte with the leftmost pixel in bit 2.
+struct Glyph {
+  char character;
+  uint8_t rows[5];
+};
+
+const Glyph glyphs[] = {
+    {'0', {7, 5, 5, 5, 7}}, {'1', {2, 6, 2, 2, 7}}, {'2', {7, 1, 7, 4, 7}},
+    {'3', {7, 1, 7, 1, 7}}, {'4', {5, 5, 7, 1, 1}}, {'5', {7, 4, 7, 1, 7}},
+    {'6', {7, 4, 7, 5, 7}}, {'7', {7, 1, 1, 1, 1}}, {'8', {7, 5, 7, 5, 7}},
+    {'9', {7, 5, 7, 1, 7}}, {'.', {0, 0, 0, 0, 2}}, {'$', {3, 6, 2, 3, 6}},
+    {'-', {0, 0, 7, 0, 0}}};
+
+class Canvas {
+private:
+  int width;
+  int height;
+  std::vector<uint8_t> pixels;
+
+public:
+  Canvas(int width, int height)
+      : width(width), height(height),
+        pixels(static_cast<size_t>(width) * height, Background) {}
+
+  void set(int x, int y, uint8_t color) {
+    if (x >= 0 && x < width && y >= 0 && y < height) {
+      pixels[static_cast<size_t>(y) * width + x] = color;
+    }
+  }
+
+  void horizontalLine(int y, uint8_t color) {
+    for (int x = 0; x < width; x++) {
+      set(x, y, color);
+    }
+  }
+
+  void verticalLine(int x, int y0, int y1, uint8_t color) {
+    for (int y = std::min(y0, y1); y <= std::max(y0, y1); y++) {
+      set(x, y, color);
+    }
+  }
+
+  void line(int x0, int y0, int x1, int y1, uint8_t color) {
+    int dx = std::abs(x1 - x0);
+    int dy = -std::abs(y1 - y0);
+    int stepX = x0 < x1 ? 1 : -1;
+    int stepY = y0 < y1 ? 1 : -1;
+    int error = dx + dy;
+
+    while (true) {
+      set(x0, y0, color);
+
+      if (x0 == x1 && y0 == y1) {
+        break;
+      }
+
+      int doubledError = 2 * error;
+
+      if (doubledError >= dy) {
+        error += dy;
+        x0 += stepX;
+      }
+
+      if (doubledError <= dx) {
+        error += dx;
+        y0 += stepY;
+      }
+    }
+  }
+
+  void text(int x, int y, const std::string &value, int scale,
+            uint8_t color) {
+    for (char character : value) {
+      for (const Glyph &glyph : glyphs) {
+        if (glyph.character != character) {
+          continue;
+        }
+
+        for (int row = 0; row < 5; row++) {
+          for (int column = 0; column < 3; column++) {
+            if (!(glyph.rows[row] & (4 >> column))) {
+              continue;
+            }
+
+            for (int sy = 0; sy < scale; sy++) {
+              for (int sx = 0; sx < scale; sx++) {
+                set(x + column * scale + sx, y + row * scale + sy, color);
+              }
+            }
+          }
+        }
+      }
+
+      x += 4 * scale;
+    }
+  }
+
+  const std::vector<uint8_t> &data() const { return pixels; }
+};
+
+void appendUint32(std::string &output, uint32_t value) {
+  output.push_back(static_cast<char>((value >> 24) & 0xff));
+  output.push_back(static_cast<char>((value >> 16) & 0xff));
+  output.push_back(static_cast<char>((value >> 8) & 0xff));
+  output.push_back(static_cast<char>(value & 0xff));
+}
+
+void appendChunk(std::string &output, const char *type,
+                 const std::string &data) {
+  appendUint32(output, static_cast<uint32_t>(data.size()));
+
+  size_t typeOffset = output.size();
+  output.append(type, 4);
+  output.append(data);
+
+  uLong crc = crc32(0L, Z_NULL, 0);
+  crc = crc32(crc,
+              reinterpret_cast<const Bytef *>(output.data() + typeOffset),
+              static_cast<uInt>(data.size() + 4));
+  appendUint32(output, static_cast<uint32_t>(crc));
+}
+
+std::string encodePalettePng(const std::vector<uint8_t> &pixels, int width,
+                             int height) {
+  std::string output("\x89PNG\r\n\x1a\n", 8);
+
+  std::string header;
+  appendUint32(header, static_cast<uint32_t>(width));
+  appendUint32(header, static_cast<uint32_t>(height));
+  header.push_back(8); // bit depth
+  header.push_back(3); // indexed color
+  header.push_back(0); // deflate
+  header.push_back(0); // adaptive filtering
+  header.push_back(0); // no interlace
+  appendChunk(output, "IHDR", header);
+
+  std::string paletteData;
+  for (const auto &color : palette) {
+    paletteData.append(reinterpret_cast<const char *>(color), 3);
+  }
+  appendChunk(output, "PLTE", paletteData);
+
+  // Every scanline is prefixed with filter type 0 (none).
+  std::vector<uint8_t> scanlines;
+  scanlines.reserve(static_cast<size_t>(width + 1) * height);
+  for (int y = 0; y < height; y++) {
+    scanlines.push_back(0);
+    scanlines.insert(scanlines.end(), pixels.begin() + y * width,
+                     pixels.begin() + (y + 1) * width);
+  }
+
+  uLongf compressedSize = compressBound(static_cast<uLong>(scanlines.size()));
+  std::string compressed(compressedSize, '\0');
+
+  if (compress2(reinterpret_cast<Bytef *>(&compressed[0]), &compressedSize,
+                scanlines.data(), static_cast<uLong>(scanlines.size()),
+                Z_BEST_SPEED) != Z_OK) {
+    std::cerr << "Failed to compress chart image." << std::endl;
+    return "";
+  }
+
+  compressed.resize(compressedSize);
+  appendChunk(output, "IDAT", compressed);
+  appendChunk(output, "IEND", "");
+
+  return output;
+}
+
+std::string formatLabel(double price) {
+  char buffer[32];
+  std::snprintf(buffer, sizeof(buffer), "$%.*f", price < 10.0 ? 4 : 2, price);
+  return buffer;
+}
+
+} // namespace
+
+std::vector<ChartColumn> downsampleBars(const std::vector<Bar> &bars,
+                                        size_t columns) {
+  std::vector<ChartColumn> result;
+
+  if (bars.empty() || columns == 0) {
+    return result;
+  }
+
+  size_t count = bars.size();
+  size_t bucketCount = std::min(count, columns);
+  result.reserve(bucketCount);
+
+  for (size_t bucket = 0; bucket < bucketCount; bucket++) {
+    size_t begin = bucket * count / bucketCount;
+    size_t end = (bucket + 1) * count / bucketCount;
+
+    // Two independent accumulators per extreme keep the loop free of
+    // dependent branches so it pipelines well.
+    double low0 = bars[begin].low, low1 = low0;
+    double high0 = bars[begin].high, high1 = high0;
+    size_t i = begin + 1;
+
+    for (; i + 1 < end; i += 2) {
+      low0 = std::min(low0, bars[i].low);
+      low1 = std::min(low1, bars[i + 1].low);
+      high0 = std::max(high0, bars[i].high);
+      high1 = std::max(high1, bars[i + 1].high);
+    }
+
+    if (i < end) {
+      low0 = std::min(low0, bars[i].low);
+      high0 = std::max(high0, bars[i].high);
+    }
+
+    result.push_back(ChartColumn{std::min(low0, low1), std::max(high0, high1),
+                                 bars[end - 1].close});
+  }
+
+  return result;
+}
+
+std::string renderChartPng(const std::vector<ChartColumn> &columns, int width,
+                           int height) {
+  Canvas canvas(width, height);
+
+  if (columns.empty()) {
+    return encodePalettePng(canvas.data(), width, height);
+  }
+
+  double low = columns[0].low;
+  double high = columns[0].high;
+  for (const ChartColumn &column : columns) {
+    low = std::min(low, column.low);
+    high = std::max(high, column.high);
+  }
+
+  const int labelScale = 2;
+  const int top = 24;
+  const int bottom = height - 24;
+  double span = (high - low > 0.0) ? (high - low) : 1.0;
+
+  auto toY = [&](double price) {
+    return bottom - static_cast<int>(std::lround((price - low) / span *
+                                                 (bottom - top)));
+  };
+
+  auto toX = [&](size_t index) {
+    if (columns.size() == 1) {
+      return width / 2;
+    }
+
+    return static_cast<int>(index * (width - 1) / (columns.size() - 1));
+  };
+
+  for (int i = 0; i <= 4; i++) {
+    canvas.horizontalLine(top + (bottom - top) * i / 4, Grid);
+  }
+
+  bool rising = columns.back().close >= columns.front().close;
+  uint8_t lineColor = rising ? Rising : Falling;
+  uint8_t fillColor = rising ? RisingFill : FallingFill;
+
+  int previousX = toX(0);
+  int previousY = toY(columns[0].close);
+
+  for (size_t i = 0; i < columns.size(); i++) {
+    int x = toX(i);
+    int closeY = toY(columns[i].close);
+
+    for (int fillX = (i == 0) ? x : previousX + 1; fillX <= x; fillX++) {
+      canvas.verticalLine(fillX, closeY + 1, bottom, fillColor);
+    }
+
+    previousX = x;
+  }
+
+  previousX = toX(0);
+
+  for (size_t i = 0; i < columns.size(); i++) {
+    int x = toX(i);
+    int closeY = toY(columns[i].close);
+
+    canvas.verticalLine(x, toY(columns[i].low), toY(columns[i].high),
+                        lineColor);
+    canvas.line(previousX, previousY, x, closeY, lineColor);
+
+    previousX = x;
+    previousY = closeY;
+  }
+
+  canvas.text(6, 6, formatLabel(high), labelScale, Text);
+  canvas.text(6, height - 16, formatLabel(low), labelScale, Text);
+
+  return encodePalettePng(canvas.data(), width, height);
+}
+
+ChartCache::ChartCache(size_t maxEntries) : maxEntries(maxEntries) {}
+
+bool ChartCache::get(const std::string &key, std::string &image) {
+  std::lock_guard<std::mutex> lock(cacheMutex);
+
+  auto imageIt = images.find(key);
+
+  if (imageIt == images.end()) {
+    return false;
+  }
+
+  image = imageIt->second;
+  return true;
+}
+
+void ChartCache::put(const std::string &key, const std::string &image) {
+  std::lock_guard<std::mutex> lock(cacheMutex);
+
+  if (images.count(key)) {
+    images[key] = image;
+    return;
+  }
+
+  while (!insertionOrder.empty() && images.size() >= maxEntries) {
+    images.erase(insertionOrder.front());
+    insertionOrder.pop_front();
+  }
+
+  images[key] = image;
+  insertionOrder.push_back(key);
+}
@@ -0,0 +1,177 @@
+#include "../include/commandRegistry.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+namespace {
+
+std::string choiceValueString(const dpp::command_value &value) {
+  std::ostringstream oss;
+
+  if (std::holds_alternative<std::string>(value)) {
+    oss << "s:" << std::get<std::string>(value);
+  } else if (std::holds_alternative<int64_t>(value)) {
+    oss << "i:" << std::get<int64_t>(value);
+  } else if (std::holds_alternative<double>(value)) {
+    oss << "d:" << std::get<double>(value);
+  } else if (std::holds_alternative<bool>(value)) {
+    oss << "b:" << std::get<bool>(value);
+  }
+
+  return oss.str();
+}
+
+void appendOptionSignature(std::ostringstream &oss,
+                           const dpp::command_option &option) {
+  oss << "{" << static_cast<int>(option.type) << "|" << option.name << "|"
+      << option.description << "|" << option.required << "|"
+      << option.autocomplete;
+
+  for (const auto &choice : option.choices) {
+    oss << "|(" << choice.name << "=" << choiceValueString(choice.value)
+        << ")";
+  }
+
+  for (const auto &subOption : option.options) {
+    appendOptionSignature(oss, subOption);
+  }
+
+  oss << "}";
+}
+
+uint64_t fnv1a(const std::string &data, uint64_t hash) {
+  for (unsigned char byte : data) {
+    hash ^= byte;
+    hash *= 0x100000001b3ULL;
+  }
+
+  return hash;
+}
+
+bool readCachedHash(const std::string &hashPath, uint64_t &hash) {
+  std::ifstream file(hashPath, std::ifstream::in);
+
+  if (!file.is_open()) {
+    return false;
+  }
+
+  file >> std::hex >> hash;
+
+  return !file.fail();
+}
+
+void writeCachedHash(const std::string &hashPath, uint64_t hash) {
+  std::ofstream file(hashPath, std::ofstream::out | std::ofstream::trunc);
+
+  if (!file.is_open()) {
+    std::cerr << "Error opening file: " << hashPath << std::endl;
+    return;
+  }
+
+  file << std::hex << std::setw(16) << std::setfill('0') << hash << std::endl;
+}
+
+} // namespace
+
+std::string commandSignature(const dpp::slashcommand &command) {
+  std::ostringstream oss;
+  oss << command.name << "|" << command.description;
+
+  for (const auto &option : command.options) {
+    appendOptionSignature(oss, option);
+  }
+
+  return oss.str();
+}
+
+uint64_t hashCommands(const std::vector<dpp::slashcommand> &commands) {
+  std::vector<std::string> signatures;
+  signatures.reserve(commands.size());
+
+  for (const auto &command : commands) {
+    signatures.push_back(commandSignature(command));
+  }
+
+  std::sort(signatures.begin(), signatures.end());
+
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (const auto &signature : signatures) {
+    hash = fnv1a(signature, hash);
+    hash = fnv1a("\n", hash);
+  }
+
+  return hash;
+}
+
+void syncSlashCommands(dpp::cluster &bot,
+                       const std::vector<dpp::slashcommand> &commands,
+                       const std::string &hashPath) {
+  uint64_t hash = hashCommands(commands);
+  uint64_t cachedHash = 0;
+
+  if (readCachedHash(hashPath, cachedHash) && cachedHash == hash) {
+    bot.log(dpp::ll_info, "Slash commands unchanged, skipping registration.");
+    return;
+  }
+
+  bot.global_commands_get([&bot, commands, hash,
+                           hashPath](const dpp::confirmation_callback_t
+                                         &callback) {
+    if (callback.is_error()) {
+      bot.log(dpp::ll_error, "Failed to get registered slash commands: " +
+                                 callback.get_error().message);
+      return;
+    }
+
+    auto registered = std::get<dpp::slashcommand_map>(callback.value);
+
+    std::map<std::string, std::string> registeredSignatures;
+    for (const auto &entry : registered) {
+      registeredSignatures[entry.second.name] = commandSignature(entry.second);
+    }
+
+    size_t changedCount = 0;
+    for (const auto &command : commands) {
+      auto registeredIt = registeredSignatures.find(command.name);
+
+      if (registeredIt == registeredSignatures.end() ||
+          registeredIt->second != commandSignature(command)) {
+        changedCount++;
+      }
+
+      if (registeredIt != registeredSignatures.end()) {
+        registeredSignatures.erase(registeredIt);
+      }
+    }
+
+    // Anything left over is registered but no longer defined locally.
+    size_t removedCount = registeredSignatures.size();
+
+    if (changedCount == 0 && removedCount == 0) {
+      writeCachedHash(hashPath, hash);
+      bot.log(dpp::ll_info, "Slash commands already up to date.");
+      return;
+    }
+
+    // A bulk overwrite replaces the whole set in one request, so there is
+    // never a window where commands are missing.
+    bot.global_bulk_command_create(
+        commands, [&bot, hash, hashPath, changedCount,
+                   removedCount](const dpp::confirmation_callback_t &result) {
+          if (result.is_error()) {
+            bot.log(dpp::ll_error, "Failed to register slash commands: " +
+                                       result.get_error().message);
+            return;
+          }
+
+          writeCachedHash(hashPath, hash);
+          bot.log(dpp::ll_info,
+                  "Registered slash commands (" +
+                      std::to_string(changedCount) + " changed, " +
+                      std::to_string(removedCount) + " removed).");
+        });
+  });
+}
@@ -0,0 +1,114 @@
+#include "../include/costBasisBackfill.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <future>
+#include <iostream>
+#include <limits>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+bool backfillCostBasis(DatabaseExecutor &dbExecutor,
+                       const std::string &dbPath) {
+  int version = dbExecutor
+                    .submit([](DatabaseHandler &dbHandler) {
+                      return dbHandler.getSchemaVersion();
+                    })
+                    .get();
+
+  if (version >= SCHEMA_VERSION_COST_BASIS_BACKFILLED) {
+    return true;
+  }
+
+  std::vector<std::string> userIds;
+  int64_t throughId;
+
+  std::tie(userIds, throughId) =
+      dbExecutor
+          .submit([](DatabaseHandler &dbHandler) {
+            return std::make_pair(dbHandler.getLedgerUserIds(),
+                                  dbHandler.getLastTransactionId());
+          })
+          .get();
+
+  size_t workerCount = std::min<size_t>(
+      std::max(1u, std::thread::hardware_concurrency()), BACKFILL_MAX_WORKERS);
+  size_t rangeSize = (userIds.size() + workerCount - 1) / workerCount;
+
+  std::vector<std::future<std::pair<bool, PositionLedger>>> ranges;
+
+  for (size_t start = 0; start < userIds.size(); start += rangeSize) {
+    std::string firstUserId = userIds[start];
+    std::string lastUserId =
+        userIds[std::min(start + rangeSize, userIds.size()) - 1];
+
+    ranges.push_back(std::async(std::launch::async, [dbPath, firstUserId,
+                                                     lastUserId, throughId]() {
+      DatabaseHandler reader(dbPath);
+      PositionLedger positions;
+
+      bool success = reader.replayTransactions(positions, firstUserId,
+                                               lastUserId, 0, throughId);
+
+      return std::make_pair(success, std::move(positions));
+    }));
+  }
+
+  PositionLedger positions;
+  bool success = true;
+
+  for (auto &range : ranges) {
+    std::pair<bool, PositionLedger> result = range.get();
+
+    success = success && result.first;
+    positions.merge(result.second);
+  }
+
+  if (!success) {
+    std::cerr << "Failed to backfill cost basis." << std::endl;
+    return false;
+  }
+
+  size_t positionCount = positions.size();
+
+  success =
+      dbExecutor
+          .submit([positions = std::move(positions),
+                   throughId](DatabaseHandler &dbHandler) mutable {
+            // Another bot process may have finished the backfill already.
+            if (dbHandler.getSchemaVersion() >=
+                SCHEMA_VERSION_COST_BASIS_BACKFILLED) {
+              return true;
+            }
+
+            if (!dbHandler.beginTransaction()) {
+              return false;
+            }
+
+            // Trades made since the ledger was read are replayed on top,
+            // under the write lock, so none of them are lost.
+            if (!dbHandler.replayTransactions(
+                    positions, "", "", throughId,
+                    std::numeric_limits<int64_t>::max()) ||
+                !dbHandler.writeCostBasis(positions) ||
+                !dbHandler.setSchemaVersion(
+                    SCHEMA_VERSION_COST_BASIS_BACKFILLED)) {
+              dbHandler.rollbackTransaction();
+              return false;
+            }
+
+            return dbHandler.commitTransaction();
+          })
+          .get();
+
+  if (!success) {
+    std::cerr << "Failed to write backfilled cost basis." << std::endl;
+    return false;
+  }
+
+  std::cout << "Backfilled cost basis for " << positionCount
+            << " positions using " << ranges.size() << " workers." << std::endl;
+
+  return true;
+}
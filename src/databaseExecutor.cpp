@@ -0,0 +1,202 @@
+#include "../include/databaseExecutor.hpp"
+#include "../include/tracer.hpp"
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+DatabaseExecutor::DatabaseExecutor(const std::string &dbPath, size_t capacity)
+    : dbHandler(dbPath) {
+  size_t roundedCapacity = 2;
+  while (roundedCapacity < capacity) {
+    roundedCapacity <<= 1;
+  }
+
+  slots.reset(new Slot[roundedCapacity]);
+  mask = roundedCapacity - 1;
+
+  for (size_t i = 0; i < roundedCapacity; i++) {
+    slots[i].sequence.store(i, std::memory_order_relaxed);
+  }
+
+  worker = std::thread(&DatabaseExecutor::run, this);
+}
+
+DatabaseExecutor::~DatabaseExecutor() {
+  running.store(false);
+
+  {
+    std::lock_guard<std::mutex> lock(wakeMutex);
+    wakeCondition.notify_one();
+  }
+
+  worker.join();
+}
+
+bool DatabaseExecutor::tryPush(Task &task, bool transactional) {
+  size_t pos = enqueuePos.load(std::memory_order_relaxed);
+
+  while (true) {
+    Slot &slot = slots[pos & mask];
+    size_t sequence = slot.sequence.load(std::memory_order_acquire);
+    intptr_t difference =
+        static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+
+    if (difference == 0) {
+      if (enqueuePos.compare_exchange_weak(pos, pos + 1,
+                                           std::memory_order_relaxed)) {
+        slot.task = std::move(task);
+        slot.transactional = transactional;
+        slot.sequence.store(pos + 1, std::memory_order_release);
+        return true;
+      }
+    } else if (difference < 0) {
+      return false;
+    } else {
+      pos = enqueuePos.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+bool DatabaseExecutor::tryPop(Task &task, bool &transactional) {
+  Slot &slot = slots[dequeuePos & mask];
+  size_t sequence = slot.sequence.load(std::memory_order_acquire);
+
+  if (static_cast<intptr_t>(sequence) -
+          static_cast<intptr_t>(dequeuePos + 1) <
+      0) {
+    return false;
+  }
+
+  task = std::move(slot.task);
+  transactional = slot.transactional;
+  slot.task = nullptr;
+  slot.sequence.store(dequeuePos + mask + 1, std::memory_order_release);
+  dequeuePos++;
+
+  return true;
+}
+
+void DatabaseExecutor::post(Task task, bool transactional) {
+  // A sampled interaction carries its trace onto the executor thread, along
+  // with the time its task spent queued.
+  if (uint64_t traceId = currentTraceId()) {
+    int64_t queuedAt = traceNow();
+
+    task = [traceId, queuedAt, task = std::move(task)](DatabaseHandler &db) {
+      TraceContext context(traceId);
+      recordSpan("db.queued", queuedAt, traceNow());
+      TRACE_SCOPE("db.task");
+      task(db);
+    };
+  }
+
+  int attempts = 0;
+
+  // Backpressure: hold the caller until the executor frees a slot.
+  while (!tryPush(task, transactional)) {
+    if (++attempts < 64) {
+      std::this_thread::yield();
+    } else {
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+  }
+
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+
+  if (sleeping.load()) {
+    std::lock_guard<std::mutex> lock(wakeMutex);
+    wakeCondition.notify_one();
+  }
+}
+
+void DatabaseExecutor::runTask(Task &task, bool isolated) {
+  // Each task in a batch gets its own savepoint, so one that throws halfway
+  // leaves none of its writes behind for the batch to commit.
+  bool savepoint = isolated && dbHandler.beginTransaction();
+  bool failed = false;
+
+  try {
+    task(dbHandler);
+  } catch (const std::exception &e) {
+    std::cerr << "Database task failed: " << e.what() << std::endl;
+    failed = true;
+  } catch (...) {
+    std::cerr << "Database task failed." << std::endl;
+    failed = true;
+  }
+
+  if (savepoint) {
+    if (failed || !dbHandler.commitTransaction()) {
+      dbHandler.rollbackTransaction();
+    }
+  }
+}
+
+void DatabaseExecutor::run() {
+  setTraceThreadName("database executor");
+
+  std::vector<Task> batch;
+  batch.reserve(DB_BATCH_SIZE);
+  Task standalone;
+
+  while (true) {
+    Task task;
+    bool transactional = true;
+
+    while (batch.size() < DB_BATCH_SIZE && tryPop(task, transactional)) {
+      if (!transactional) {
+        standalone = std::move(task);
+        break;
+      }
+
+      batch.push_back(std::move(task));
+    }
+
+    if (batch.empty() && !standalone) {
+      if (!running.load()) {
+        break;
+      }
+
+      std::unique_lock<std::mutex> lock(wakeMutex);
+      sleeping.store(true);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+
+      if (tryPop(task, transactional)) {
+        if (transactional) {
+          batch.push_back(std::move(task));
+        } else {
+          standalone = std::move(task);
+        }
+      } else if (running.load()) {
+        wakeCondition.wait_for(lock, std::chrono::milliseconds(10));
+      }
+
+      sleeping.store(false);
+      continue;
+    }
+
+    if (!batch.empty()) {
+      // Even a single task runs in a transaction so its reads and writes are
+      // atomic with respect to other bot processes sharing the file. Tasks
+      // defer their replies with afterCommit, so a batch that fails to commit
+      // reports failure instead of success for writes that were lost.
+      bool grouped = dbHandler.beginTransaction();
+
+      for (Task &queuedTask : batch) {
+        runTask(queuedTask, grouped);
+      }
+
+      if (grouped && !dbHandler.commitTransaction()) {
+        dbHandler.rollbackTransaction();
+      }
+
+      batch.clear();
+    }
+
+    if (standalone) {
+      runTask(standalone, false);
+      standalone = nullptr;
+    }
+  }
+}
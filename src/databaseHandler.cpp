@@ -1,17 +1,53 @@
 #include "../include/databaseHandler.hpp"
+#include "../include/tracer.hpp"
+#include <algorithm>
 #include <iostream>
 
+void applyTrade(Position &position, int quantityChange, double price) {
+  if (quantityChange > 0) {
+    double totalCost = position.averageCost * position.quantity +
+                       price * quantityChange;
+
+    position.quantity += quantityChange;
+    position.averageCost = totalCost / position.quantity;
+    return;
+  }
+
+  int quantitySold = std::min(-quantityChange, position.quantity);
+
+  position.realizedPnl += (price - position.averageCost) * quantitySold;
+  position.quantity -= quantitySold;
+
+  if (position.quantity == 0) {
+    position.averageCost = 0.0;
+  }
+}
+
 DatabaseHandler::DatabaseHandler(const std::string &dbPath) {
   int rc = sqlite3_open(dbPath.c_str(), &db);
 
   if (rc != SQLITE_OK) {
     std::cerr << "Failed to open database file." << std::endl;
+    return;
+  }
+
+  // Several bot processes may share the file, so let readers run alongside
+  // the writer and wait for the write lock instead of failing.
+  sqlite3_busy_timeout(db, 5000);
+
+  if (sqlite3_exec(db, "PRAGMA journal_mode=WAL;", nullptr, nullptr,
+                   nullptr) != SQLITE_OK) {
+    std::cerr << "Failed to enable write-ahead logging." << std::endl;
   }
 }
 
 DatabaseHandler::~DatabaseHandler() { sqlite3_close(db); }
 
+sqlite3 *DatabaseHandler::getConnection() { return db; }
+
 bool DatabaseHandler::insertUser(const std::string &userId) {
+  TRACE_SCOPE("db.insertUser");
+
   // std::lock_guard<std::mutex> lock(connectionMutex);
 
   std::string insertUserQuery =
@@ -42,6 +78,8 @@ bool DatabaseHandler::insertUser(const std::string &userId) {
 
 bool DatabaseHandler::insertUserStock(const std::string &userId,
                                       const std::string &stockName) {
+  TRACE_SCOPE("db.insertUserStock");
+
   // std::lock_guard<std::mutex> lock(connectionMutex);
 
   std::string query = "INSERT INTO user_stocks (user_id, stock_name, quantity) "
@@ -71,6 +109,8 @@ bool DatabaseHandler::insertUserStock(const std::string &userId,
 }
 
 bool DatabaseHandler::userExists(const std::string &userId) {
+  TRACE_SCOPE("db.userExists");
+
   // std::lock_guard<std::mutex> lock(connectionMutex);
 
   std::string query = "SELECT 1 FROM users WHERE user_id = ?";
@@ -100,6 +140,8 @@ bool DatabaseHandler::userExists(const std::string &userId) {
 
 bool DatabaseHandler::userHasStock(const std::string &userId,
                                    const std::string &stockName) {
+  TRACE_SCOPE("db.userHasStock");
+
   // std::lock_guard<std::mutex> lock(connectionMutex);
 
   std::string query =
@@ -158,23 +200,213 @@ bool DatabaseHandler::createTables() {
       "FOREIGN KEY (user_id) REFERENCES users(user_id)"
       ");";
 
+  const std::string createUserOrdersTableQuery =
+      "CREATE TABLE IF NOT EXISTS user_orders ("
+      "order_id INTEGER PRIMARY KEY AUTOINCREMENT,"
+      "user_id TEXT,"
+      "stock_name TEXT,"
+      "side TEXT,"
+      "order_type TEXT,"
+      "quantity INTEGER,"
+      "trigger_price REAL,"
+      "timestamp TEXT,"
+      "FOREIGN KEY (user_id) REFERENCES users(user_id)"
+      ");";
+
+  const std::string createUserRollupsTableQuery =
+      "CREATE TABLE IF NOT EXISTS user_rollups ("
+      "user_id TEXT,"
+      "stock_name TEXT,"
+      "trade_count INTEGER,"
+      "quantity_bought INTEGER,"
+      "quantity_sold INTEGER,"
+      "total_spent REAL,"
+      "total_received REAL,"
+      "last_timestamp TEXT,"
+      "PRIMARY KEY (user_id, stock_name),"
+      "FOREIGN KEY (user_id) REFERENCES users(user_id)"
+      ");";
+
   int rc1 = sqlite3_exec(db, createUsersTableQuery.c_str(), nullptr, nullptr,
                          nullptr);
   int rc2 = sqlite3_exec(db, createUserStocksTableQuery.c_str(), nullptr,
                          nullptr, nullptr);
   int rc3 = sqlite3_exec(db, createUserTransactionsTableQuery.c_str(), nullptr,
                          nullptr, nullptr);
+  int rc4 = sqlite3_exec(db, createUserOrdersTableQuery.c_str(), nullptr,
+                         nullptr, nullptr);
+  int rc5 = sqlite3_exec(db, createUserRollupsTableQuery.c_str(), nullptr,
+                         nullptr, nullptr);
 
-  if (rc1 != SQLITE_OK || rc2 != SQLITE_OK || rc3 != SQLITE_OK) {
+  if (rc1 != SQLITE_OK || rc2 != SQLITE_OK || rc3 != SQLITE_OK ||
+      rc4 != SQLITE_OK || rc5 != SQLITE_OK) {
     std::cerr << "Failed to create tables." << std::endl;
     return false;
   }
 
+  if (getSchemaVersion() < SCHEMA_VERSION_COST_BASIS) {
+    const std::string costBasisMigration =
+        "ALTER TABLE user_stocks ADD COLUMN avg_cost REAL DEFAULT 0;"
+        "ALTER TABLE user_stocks ADD COLUMN realized_pnl REAL DEFAULT 0;"
+        "CREATE INDEX IF NOT EXISTS user_transactions_by_user "
+        "ON user_transactions (user_id, transaction_id);";
+
+    // Other bot processes may be starting on the same file, so the version
+    // is checked again once the write lock is held, and the migration is
+    // applied whole or not at all.
+    if (!beginTransaction()) {
+      std::cerr << "Failed to add cost basis columns." << std::endl;
+      return false;
+    }
+
+    if (getSchemaVersion() < SCHEMA_VERSION_COST_BASIS &&
+        (sqlite3_exec(db, costBasisMigration.c_str(), nullptr, nullptr,
+                      nullptr) != SQLITE_OK ||
+         !setSchemaVersion(SCHEMA_VERSION_COST_BASIS))) {
+      std::cerr << "Failed to add cost basis columns." << std::endl;
+      rollbackTransaction();
+      return false;
+    }
+
+    if (!commitTransaction()) {
+      rollbackTransaction();
+      return false;
+    }
+  }
+
   return true;
 }
 
+int DatabaseHandler::getSchemaVersion() {
+  int version = 0;
+  sqlite3_stmt *stmt;
+
+  if (sqlite3_prepare_v2(db, "PRAGMA user_version;", -1, &stmt, nullptr) ==
+      SQLITE_OK) {
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+      version = sqlite3_column_int(stmt, 0);
+    }
+
+    sqlite3_finalize(stmt);
+  } else {
+    std::cerr << "Failed to read schema version." << std::endl;
+  }
+
+  return version;
+}
+
+bool DatabaseHandler::setSchemaVersion(int version) {
+  std::string query = "PRAGMA user_version = " + std::to_string(version) + ";";
+
+  if (sqlite3_exec(db, query.c_str(), nullptr, nullptr, nullptr) !=
+      SQLITE_OK) {
+    std::cerr << "Failed to set schema version." << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+bool DatabaseHandler::beginTransaction() {
+  TRACE_SCOPE("db.beginTransaction");
+
+  const char *query =
+      (transactionDepth == 0) ? "BEGIN IMMEDIATE;" : "SAVEPOINT txn;";
+
+  if (sqlite3_exec(db, query, nullptr, nullptr, nullptr) != SQLITE_OK) {
+    std::cerr << "Failed to begin transaction." << std::endl;
+    return false;
+  }
+
+  transactionDepth++;
+  return true;
+}
+
+bool DatabaseHandler::commitTransaction() {
+  TRACE_SCOPE("db.commitTransaction");
+
+  const char *query = (transactionDepth == 1) ? "COMMIT;" : "RELEASE txn;";
+
+  if (transactionDepth == 0 ||
+      sqlite3_exec(db, query, nullptr, nullptr, nullptr) != SQLITE_OK) {
+    std::cerr << "Failed to commit transaction." << std::endl;
+    return false;
+  }
+
+  transactionDepth--;
+
+  if (transactionDepth == 0) {
+    std::vector<std::pair<int, std::function<void(bool)>>> callbacks;
+    callbacks.swap(commitCallbacks);
+
+    for (auto &callback : callbacks) {
+      callback.second(true);
+    }
+  } else {
+    // Released into the enclosing transaction, so they now roll back with it.
+    for (auto &callback : commitCallbacks) {
+      callback.first = std::min(callback.first, transactionDepth);
+    }
+  }
+
+  return true;
+}
+
+bool DatabaseHandler::rollbackTransaction() {
+  TRACE_SCOPE("db.rollbackTransaction");
+
+  const char *query = (transactionDepth == 1)
+                          ? "ROLLBACK;"
+                          : "ROLLBACK TO txn; RELEASE txn;";
+  int rolledBackDepth = transactionDepth;
+
+  if (transactionDepth == 0 ||
+      sqlite3_exec(db, query, nullptr, nullptr, nullptr) != SQLITE_OK) {
+    std::cerr << "Failed to roll back transaction." << std::endl;
+
+    // SQLite ends the transaction itself on some errors.
+    if (sqlite3_get_autocommit(db)) {
+      transactionDepth = 0;
+    }
+  } else {
+    transactionDepth--;
+  }
+
+  // Whatever was registered inside the rolled back transaction will not
+  // commit, even if rolling back itself failed.
+  auto cancelled = std::stable_partition(
+      commitCallbacks.begin(), commitCallbacks.end(),
+      [this, rolledBackDepth](
+          const std::pair<int, std::function<void(bool)>> &callback) {
+        return callback.first < rolledBackDepth &&
+               callback.first <= transactionDepth;
+      });
+  std::vector<std::pair<int, std::function<void(bool)>>> callbacks(
+      std::make_move_iterator(cancelled),
+      std::make_move_iterator(commitCallbacks.end()));
+  commitCallbacks.erase(cancelled, commitCallbacks.end());
+
+  for (auto &callback : callbacks) {
+    callback.second(false);
+  }
+
+  return transactionDepth < rolledBackDepth;
+}
+
+void DatabaseHandler::afterCommit(
+    std::function<void(bool committed)> callback) {
+  if (transactionDepth == 0) {
+    callback(true);
+    return;
+  }
+
+  commitCallbacks.emplace_back(transactionDepth, std::move(callback));
+}
+
 bool DatabaseHandler::updateUserBalance(const std::string &userId,
                                         double balanceChange) {
+  TRACE_SCOPE("db.updateUserBalance");
+
   // std::lock_guard<std::mutex> lock(connectionMutex);
 
   if (!userExists(userId)) {
@@ -215,7 +447,9 @@ bool DatabaseHandler::updateUserBalance(const std::string &userId,
 
 bool DatabaseHandler::updateUserStock(const std::string &userId,
                                       const std::string &stockName,
-                                      int quantityChange) {
+                                      int quantityChange, double price) {
+  TRACE_SCOPE("db.updateUserStock");
+
   // std::lock_guard<std::mutex> lock(connectionMutex);
 
   if (!userHasStock(userId, stockName)) {
@@ -224,20 +458,46 @@ bool DatabaseHandler::updateUserStock(const std::string &userId,
     }
   }
 
-  int newQuantity = getUserStockQuantity(userId, stockName) + quantityChange;
+  Position position;
+  position.stockName = stockName;
+
+  std::string selectQuery = "SELECT quantity, avg_cost, realized_pnl FROM "
+                            "user_stocks WHERE user_id = ? AND stock_name = ?";
+  sqlite3_stmt *stmt;
 
-  if (newQuantity < 0) {
+  if (sqlite3_prepare_v2(db, selectQuery.c_str(), -1, &stmt, nullptr) !=
+      SQLITE_OK) {
+    std::cerr << "Failed to prepare statement for getting user's position."
+              << std::endl;
     return false;
   }
 
-  std::string query = "UPDATE user_stocks SET quantity = ? WHERE user_id = ? "
-                      "AND stock_name = ?";
-  sqlite3_stmt *stmt;
+  sqlite3_bind_text(stmt, 1, userId.c_str(), -1, SQLITE_STATIC);
+  sqlite3_bind_text(stmt, 2, stockName.c_str(), -1, SQLITE_STATIC);
+
+  if (sqlite3_step(stmt) == SQLITE_ROW) {
+    position.quantity = sqlite3_column_int(stmt, 0);
+    position.averageCost = sqlite3_column_double(stmt, 1);
+    position.realizedPnl = sqlite3_column_double(stmt, 2);
+  }
+
+  sqlite3_finalize(stmt);
+
+  if (position.quantity + quantityChange < 0) {
+    return false;
+  }
+
+  applyTrade(position, quantityChange, price);
+
+  std::string query = "UPDATE user_stocks SET quantity = ?, avg_cost = ?, "
+                      "realized_pnl = ? WHERE user_id = ? AND stock_name = ?";
 
   if (sqlite3_prepare_v2(db, query.c_str(), -1, &stmt, nullptr) == SQLITE_OK) {
-    sqlite3_bind_int(stmt, 1, newQuantity);
-    sqlite3_bind_text(stmt, 2, userId.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 3, stockName.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 1, position.quantity);
+    sqlite3_bind_double(stmt, 2, position.averageCost);
+    sqlite3_bind_double(stmt, 3, position.realizedPnl);
+    sqlite3_bind_text(stmt, 4, userId.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 5, stockName.c_str(), -1, SQLITE_STATIC);
 
     int result = sqlite3_step(stmt);
 
@@ -260,6 +520,8 @@ bool DatabaseHandler::updateTransactionsHistory(const std::string &userId,
                                                 const std::string &stockName,
                                                 int quantity, double price,
                                                 const std::string &timestamp) {
+  TRACE_SCOPE("db.updateTransactionsHistory");
+
   // std::lock_guard<std::mutex> lock(connectionMutex);
 
   std::string query = "INSERT INTO user_transactions (user_id, stock_name, "
@@ -291,25 +553,31 @@ bool DatabaseHandler::updateTransactionsHistory(const std::string &userId,
   return false;
 }
 
-std::vector<std::pair<std::string, int>>
-DatabaseHandler::getUserStocks(const std::string &userId) {
+std::pmr::vector<Position>
+DatabaseHandler::getUserStocks(const std::string &userId,
+                               std::pmr::memory_resource *resource) {
+  TRACE_SCOPE("db.getUserStocks");
+
   // std::lock_guard<std::mutex> lock(connectionMutex);
 
-  std::vector<std::pair<std::string, int>> userStocks;
+  std::pmr::vector<Position> userStocks(resource);
 
-  std::string query =
-      "SELECT stock_name, quantity FROM user_stocks WHERE user_id = ?";
+  const char *query = "SELECT stock_name, quantity, avg_cost, realized_pnl "
+                      "FROM user_stocks WHERE user_id = ?";
   sqlite3_stmt *stmt;
 
-  if (sqlite3_prepare_v2(db, query.c_str(), -1, &stmt, nullptr) == SQLITE_OK) {
+  if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) == SQLITE_OK) {
     sqlite3_bind_text(stmt, 1, userId.c_str(), -1, SQLITE_STATIC);
 
     while (sqlite3_step(stmt) == SQLITE_ROW) {
       const char *stockName =
           reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0));
-      int quantity = sqlite3_column_int(stmt, 1);
 
-      userStocks.emplace_back(stockName ? stockName : "", quantity);
+      Position &position = userStocks.emplace_back();
+      position.stockName = stockName ? stockName : "";
+      position.quantity = sqlite3_column_int(stmt, 1);
+      position.averageCost = sqlite3_column_double(stmt, 2);
+      position.realizedPnl = sqlite3_column_double(stmt, 3);
     }
 
     sqlite3_finalize(stmt);
@@ -322,6 +590,8 @@ DatabaseHandler::getUserStocks(const std::string &userId) {
 }
 
 double DatabaseHandler::getUserBalance(const std::string &userId) {
+  TRACE_SCOPE("db.getUserBalance");
+
   // std::lock_guard<std::mutex> lock(connectionMutex);
 
   if (!userExists(userId)) {
@@ -342,6 +612,8 @@ double DatabaseHandler::getUserBalance(const std::string &userId) {
     } else {
       std::cerr << "Failed to find user." << std::endl;
     }
+
+    sqlite3_finalize(stmt);
   } else {
     std::cerr << "Failed to prepare statement for getting user balance."
               << std::endl;
@@ -352,6 +624,8 @@ double DatabaseHandler::getUserBalance(const std::string &userId) {
 
 int DatabaseHandler::getUserStockQuantity(const std::string &userId,
                                           const std::string &stockName) {
+  TRACE_SCOPE("db.getUserStockQuantity");
+
   // std::lock_guard<std::mutex> lock(connectionMutex);
 
   int stockQuantity = 0;
@@ -380,42 +654,626 @@ int DatabaseHandler::getUserStockQuantity(const std::string &userId,
   return stockQuantity;
 }
 
-std::vector<std::vector<std::string>>
-DatabaseHandler::getUserHistory(const std::string &userId) {
-  // std::lock_guard<std::mutex> lock(connectionMutex);
+double DatabaseHandler::getUserRealizedPnl(const std::string &userId) {
+  TRACE_SCOPE("db.getUserRealizedPnl");
 
-  std::vector<std::vector<std::string>> history;
+  double realizedPnl = 0.0;
 
-  std::string query = "SELECT stock_name, quantity, price, timestamp FROM "
-                      "user_transactions WHERE user_id = ?";
+  const char *query = "SELECT COALESCE(SUM(realized_pnl), 0) FROM user_stocks "
+                      "WHERE user_id = ?";
   sqlite3_stmt *stmt;
 
-  if (sqlite3_prepare_v2(db, query.c_str(), -1, &stmt, nullptr) == SQLITE_OK) {
+  if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) == SQLITE_OK) {
     sqlite3_bind_text(stmt, 1, userId.c_str(), -1, SQLITE_STATIC);
 
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-      std::vector<std::string> values;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+      realizedPnl = sqlite3_column_double(stmt, 0);
+    }
+
+    sqlite3_finalize(stmt);
+  } else {
+    std::cerr << "Failed to prepare statement for getting realized P&L."
+              << std::endl;
+  }
+
+  return realizedPnl;
+}
+
+std::pmr::vector<Position>
+DatabaseHandler::getUserStocksPage(const std::string &userId,
+                                   const std::string &cursor, bool forward,
+                                   int limit,
+                                   std::pmr::memory_resource *resource) {
+  TRACE_SCOPE("db.getUserStocksPage");
+
+  std::pmr::vector<Position> positions(resource);
+
+  const char *query =
+      forward ? "SELECT stock_name, quantity, avg_cost, realized_pnl FROM "
+                "user_stocks WHERE user_id = ? AND quantity > 0 AND "
+                "stock_name > ? ORDER BY stock_name LIMIT ?"
+              : "SELECT stock_name, quantity, avg_cost, realized_pnl FROM "
+                "user_stocks WHERE user_id = ? AND quantity > 0 AND "
+                "stock_name < ? ORDER BY stock_name DESC LIMIT ?";
+  sqlite3_stmt *stmt;
 
+  if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) == SQLITE_OK) {
+    sqlite3_bind_text(stmt, 1, userId.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, cursor.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 3, limit);
+
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
       const char *stockName =
           reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0));
-      int quantity = sqlite3_column_int(stmt, 1);
-      double price = sqlite3_column_double(stmt, 2);
+
+      Position &position = positions.emplace_back();
+      position.stockName = stockName ? stockName : "";
+      position.quantity = sqlite3_column_int(stmt, 1);
+      position.averageCost = sqlite3_column_double(stmt, 2);
+      position.realizedPnl = sqlite3_column_double(stmt, 3);
+    }
+
+    sqlite3_finalize(stmt);
+  } else {
+    std::cerr << "Failed to prepare statement for getting user stocks."
+              << std::endl;
+  }
+
+  if (!forward) {
+    std::reverse(positions.begin(), positions.end());
+  }
+
+  return positions;
+}
+
+std::pmr::vector<TransactionRecord>
+DatabaseHandler::getUserHistoryPage(const std::string &userId, int64_t cursor,
+                                    bool older, int limit,
+                                    std::pmr::memory_resource *resource) {
+  TRACE_SCOPE("db.getUserHistoryPage");
+
+  // std::lock_guard<std::mutex> lock(connectionMutex);
+
+  std::pmr::vector<TransactionRecord> history(resource);
+
+  // Archived rows are all older than the hot ones, so walking the hot ledger
+  // and then the archive (or the reverse, going newer) keeps the order.
+  const char *hotQuery =
+      older ? "SELECT transaction_id, stock_name, quantity, price, timestamp "
+              "FROM main.user_transactions WHERE user_id = ? AND "
+              "transaction_id < ? ORDER BY transaction_id DESC LIMIT ?"
+            : "SELECT transaction_id, stock_name, quantity, price, timestamp "
+              "FROM main.user_transactions WHERE user_id = ? AND "
+              "transaction_id > ? ORDER BY transaction_id LIMIT ?";
+  const char *archiveQuery =
+      older ? "SELECT transaction_id, stock_name, quantity, price, timestamp "
+              "FROM archive.user_transactions WHERE user_id = ? AND "
+              "transaction_id < ? ORDER BY transaction_id DESC LIMIT ?"
+            : "SELECT transaction_id, stock_name, quantity, price, timestamp "
+              "FROM archive.user_transactions WHERE user_id = ? AND "
+              "transaction_id > ? ORDER BY transaction_id LIMIT ?";
+
+  const char *sources[2] = {older ? hotQuery : archiveQuery,
+                            older ? archiveQuery : hotQuery};
+
+  for (const char *query : sources) {
+    int remaining = limit - static_cast<int>(history.size());
+
+    if (remaining <= 0) {
+      break;
+    }
+
+    if (query == archiveQuery && !archiveAttached) {
+      continue;
+    }
+
+    sqlite3_stmt *stmt;
+
+    if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) != SQLITE_OK) {
+      std::cerr
+          << "Failed to prepare statement for getting transaction history."
+          << std::endl;
+      break;
+    }
+
+    sqlite3_bind_text(stmt, 1, userId.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 2, cursor);
+    sqlite3_bind_int(stmt, 3, remaining);
+
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+      const char *stockName =
+          reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1));
       const char *timestamp =
-          reinterpret_cast<const char *>(sqlite3_column_text(stmt, 3));
+          reinterpret_cast<const char *>(sqlite3_column_text(stmt, 4));
+
+      // TransactionRecord is not allocator-aware, so its strings are given
+      // the resource explicitly.
+      history.push_back(TransactionRecord{
+          sqlite3_column_int64(stmt, 0),
+          std::pmr::string(stockName ? stockName : "", resource),
+          sqlite3_column_int(stmt, 2), sqlite3_column_double(stmt, 3),
+          std::pmr::string(timestamp ? timestamp : "", resource)});
+    }
 
-      values.push_back(stockName);
-      values.push_back(std::to_string(quantity));
-      values.push_back(std::to_string(price));
-      values.push_back(timestamp);
+    sqlite3_finalize(stmt);
+  }
+
+  if (!older) {
+    std::reverse(history.begin(), history.end());
+  }
 
-      history.push_back(values);
+  return history;
+}
+
+std::vector<std::string> DatabaseHandler::getLedgerUserIds() {
+  std::vector<std::string> userIds;
+
+  std::string query =
+      "SELECT DISTINCT user_id FROM user_transactions ORDER BY user_id";
+  sqlite3_stmt *stmt;
+
+  if (sqlite3_prepare_v2(db, query.c_str(), -1, &stmt, nullptr) == SQLITE_OK) {
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+      const char *userId =
+          reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0));
+
+      if (userId) {
+        userIds.push_back(userId);
+      }
     }
 
     sqlite3_finalize(stmt);
   } else {
-    std::cerr << "Failed to prepare statement for getting transaction history."
+    std::cerr << "Failed to prepare statement for getting ledger users."
               << std::endl;
   }
 
-  return history;
+  return userIds;
+}
+
+int64_t DatabaseHandler::getLastTransactionId() {
+  int64_t transactionId = 0;
+
+  std::string query =
+      "SELECT COALESCE(MAX(transaction_id), 0) FROM user_transactions";
+  sqlite3_stmt *stmt;
+
+  if (sqlite3_prepare_v2(db, query.c_str(), -1, &stmt, nullptr) == SQLITE_OK) {
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+      transactionId = sqlite3_column_int64(stmt, 0);
+    }
+
+    sqlite3_finalize(stmt);
+  } else {
+    std::cerr << "Failed to prepare statement for getting last transaction."
+              << std::endl;
+  }
+
+  return transactionId;
+}
+
+bool DatabaseHandler::replayTransactions(PositionLedger &positions,
+                                         const std::string &firstUserId,
+                                         const std::string &lastUserId,
+                                         int64_t afterId, int64_t throughId) {
+  std::string query = "SELECT user_id, stock_name, quantity, price FROM "
+                      "user_transactions WHERE user_id >= ?1 AND "
+                      "(?2 = '' OR user_id <= ?2) AND transaction_id > ?3 AND "
+                      "transaction_id <= ?4 ORDER BY user_id, transaction_id";
+  sqlite3_stmt *stmt;
+
+  if (sqlite3_prepare_v2(db, query.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+    std::cerr << "Failed to prepare statement for replaying transactions."
+              << std::endl;
+    return false;
+  }
+
+  sqlite3_bind_text(stmt, 1, firstUserId.c_str(), -1, SQLITE_STATIC);
+  sqlite3_bind_text(stmt, 2, lastUserId.c_str(), -1, SQLITE_STATIC);
+  sqlite3_bind_int64(stmt, 3, afterId);
+  sqlite3_bind_int64(stmt, 4, throughId);
+
+  int result;
+
+  while ((result = sqlite3_step(stmt)) == SQLITE_ROW) {
+    const char *userId =
+        reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0));
+    const char *stockName =
+        reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1));
+    int quantity = sqlite3_column_int(stmt, 2);
+    double value = sqlite3_column_double(stmt, 3);
+
+    if (!userId || !stockName || quantity <= 0) {
+      continue;
+    }
+
+    Position &position = positions[{userId, stockName}];
+    position.stockName = stockName;
+
+    // Purchases are recorded as negative totals.
+    if (value < 0.0) {
+      applyTrade(position, quantity, -value / quantity);
+    } else {
+      applyTrade(position, -quantity, value / quantity);
+    }
+  }
+
+  sqlite3_finalize(stmt);
+
+  if (result != SQLITE_DONE) {
+    std::cerr << "Failed to replay transactions." << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+bool DatabaseHandler::writeCostBasis(const PositionLedger &positions) {
+  std::string query = "UPDATE user_stocks SET avg_cost = ?, realized_pnl = ? "
+                      "WHERE user_id = ? AND stock_name = ?";
+  sqlite3_stmt *stmt;
+
+  if (sqlite3_prepare_v2(db, query.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+    std::cerr << "Failed to prepare statement for writing cost basis."
+              << std::endl;
+    return false;
+  }
+
+  for (const auto &entry : positions) {
+    sqlite3_bind_double(stmt, 1, entry.second.averageCost);
+    sqlite3_bind_double(stmt, 2, entry.second.realizedPnl);
+    sqlite3_bind_text(stmt, 3, entry.first.first.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 4, entry.first.second.c_str(), -1, SQLITE_STATIC);
+
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+      std::cerr << "Failed to write cost basis." << std::endl;
+      sqlite3_finalize(stmt);
+      return false;
+    }
+
+    sqlite3_reset(stmt);
+  }
+
+  sqlite3_finalize(stmt);
+
+  return true;
+}
+
+bool DatabaseHandler::attachArchive(const std::string &archivePath) {
+  std::string query = "ATTACH DATABASE ? AS archive";
+  sqlite3_stmt *stmt;
+
+  if (sqlite3_prepare_v2(db, query.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+    std::cerr << "Failed to prepare statement for attaching archive."
+              << std::endl;
+    return false;
+  }
+
+  sqlite3_bind_text(stmt, 1, archivePath.c_str(), -1, SQLITE_STATIC);
+
+  int result = sqlite3_step(stmt);
+
+  sqlite3_finalize(stmt);
+
+  if (result != SQLITE_DONE) {
+    std::cerr << "Failed to attach archive database." << std::endl;
+    return false;
+  }
+
+  const std::string createArchiveQuery =
+      "PRAGMA archive.journal_mode=WAL;"
+      "CREATE TABLE IF NOT EXISTS archive.user_transactions ("
+      "transaction_id INTEGER PRIMARY KEY,"
+      "user_id TEXT,"
+      "stock_name TEXT,"
+      "quantity INTEGER,"
+      "price REAL,"
+      "timestamp TEXT"
+      ");"
+      "CREATE INDEX IF NOT EXISTS archive.user_transactions_by_user "
+      "ON user_transactions (user_id, transaction_id);";
+
+  if (sqlite3_exec(db, createArchiveQuery.c_str(), nullptr, nullptr,
+                   nullptr) != SQLITE_OK) {
+    std::cerr << "Failed to create archive tables." << std::endl;
+    sqlite3_exec(db, "DETACH DATABASE archive;", nullptr, nullptr, nullptr);
+    return false;
+  }
+
+  archiveAttached = true;
+  return true;
+}
+
+bool DatabaseHandler::isArchiveAttached() const { return archiveAttached; }
+
+int64_t
+DatabaseHandler::getLastTransactionIdBefore(const std::string &timestamp) {
+  int64_t transactionId = 0;
+
+  std::string query =
+      "SELECT COALESCE((SELECT transaction_id - 1 FROM main.user_transactions "
+      "WHERE timestamp >= ? ORDER BY transaction_id LIMIT 1), "
+      "(SELECT MAX(transaction_id) FROM main.user_transactions), 0)";
+  sqlite3_stmt *stmt;
+
+  if (sqlite3_prepare_v2(db, query.c_str(), -1, &stmt, nullptr) == SQLITE_OK) {
+    sqlite3_bind_text(stmt, 1, timestamp.c_str(), -1, SQLITE_STATIC);
+
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+      transactionId = sqlite3_column_int64(stmt, 0);
+    }
+
+    sqlite3_finalize(stmt);
+  } else {
+    std::cerr << "Failed to prepare statement for finding old transactions."
+              << std::endl;
+  }
+
+  return transactionId;
+}
+
+static bool runWithTransactionRange(sqlite3 *db, const std::string &query,
+                                    int64_t firstId, int64_t lastId) {
+  sqlite3_stmt *stmt;
+
+  if (sqlite3_prepare_v2(db, query.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+    return false;
+  }
+
+  sqlite3_bind_int64(stmt, 1, firstId);
+  sqlite3_bind_int64(stmt, 2, lastId);
+
+  int result = sqlite3_step(stmt);
+
+  sqlite3_finalize(stmt);
+
+  return result == SQLITE_DONE;
+}
+
+int DatabaseHandler::archiveTransactions(int64_t throughId, int limit) {
+  if (!archiveAttached || transactionDepth != 0) {
+    return -1;
+  }
+
+  int64_t chunkStart = 0;
+  int64_t chunkEnd = 0;
+
+  std::string chunkQuery =
+      "SELECT COALESCE(MIN(transaction_id), 0), COALESCE(MAX(transaction_id), "
+      "0) FROM (SELECT transaction_id FROM main.user_transactions "
+      "WHERE transaction_id <= ? ORDER BY transaction_id LIMIT ?)";
+  sqlite3_stmt *stmt;
+
+  if (sqlite3_prepare_v2(db, chunkQuery.c_str(), -1, &stmt, nullptr) !=
+      SQLITE_OK) {
+    std::cerr << "Failed to prepare statement for archiving transactions."
+              << std::endl;
+    return -1;
+  }
+
+  sqlite3_bind_int64(stmt, 1, throughId);
+  sqlite3_bind_int(stmt, 2, limit);
+
+  if (sqlite3_step(stmt) == SQLITE_ROW) {
+    chunkStart = sqlite3_column_int64(stmt, 0);
+    chunkEnd = sqlite3_column_int64(stmt, 1);
+  }
+
+  sqlite3_finalize(stmt);
+
+  if (chunkEnd == 0) {
+    return 0;
+  }
+
+  // In WAL mode a commit is only atomic per database file, so the copy is
+  // committed before anything is removed. Copying again after a failure is
+  // harmless, and only rows present in the archive are ever deleted.
+  std::string copyQuery =
+      "INSERT OR IGNORE INTO archive.user_transactions SELECT transaction_id, "
+      "user_id, stock_name, quantity, price, timestamp FROM "
+      "main.user_transactions WHERE transaction_id BETWEEN ?1 AND ?2";
+
+  if (!beginTransaction()) {
+    return -1;
+  }
+
+  if (!runWithTransactionRange(db, copyQuery, chunkStart, chunkEnd) ||
+      !commitTransaction()) {
+    std::cerr << "Failed to copy transactions to archive." << std::endl;
+    rollbackTransaction();
+    return -1;
+  }
+
+  std::string archivedRows =
+      "main.user_transactions WHERE transaction_id BETWEEN ?1 AND ?2 AND "
+      "transaction_id IN (SELECT transaction_id FROM "
+      "archive.user_transactions WHERE transaction_id BETWEEN ?1 AND ?2)";
+
+  std::string rollupQuery =
+      "INSERT INTO main.user_rollups (user_id, stock_name, trade_count, "
+      "quantity_bought, quantity_sold, total_spent, total_received, "
+      "last_timestamp) SELECT user_id, stock_name, COUNT(*), "
+      "SUM(CASE WHEN price < 0 THEN quantity ELSE 0 END), "
+      "SUM(CASE WHEN price < 0 THEN 0 ELSE quantity END), "
+      "SUM(CASE WHEN price < 0 THEN -price ELSE 0 END), "
+      "SUM(CASE WHEN price < 0 THEN 0 ELSE price END), MAX(timestamp) FROM " +
+      archivedRows +
+      " GROUP BY user_id, stock_name "
+      "ON CONFLICT (user_id, stock_name) DO UPDATE SET "
+      "trade_count = trade_count + excluded.trade_count, "
+      "quantity_bought = quantity_bought + excluded.quantity_bought, "
+      "quantity_sold = quantity_sold + excluded.quantity_sold, "
+      "total_spent = total_spent + excluded.total_spent, "
+      "total_received = total_received + excluded.total_received, "
+      "last_timestamp = MAX(last_timestamp, excluded.last_timestamp)";
+
+  std::string deleteQuery = "DELETE FROM " + archivedRows;
+
+  if (!beginTransaction()) {
+    return -1;
+  }
+
+  if (!runWithTransactionRange(db, rollupQuery, chunkStart, chunkEnd) ||
+      !runWithTransactionRange(db, deleteQuery, chunkStart, chunkEnd)) {
+    std::cerr << "Failed to remove archived transactions." << std::endl;
+    rollbackTransaction();
+    return -1;
+  }
+
+  int moved = sqlite3_changes(db);
+
+  if (!commitTransaction()) {
+    rollbackTransaction();
+    return -1;
+  }
+
+  return moved;
+}
+
+int64_t DatabaseHandler::insertOrder(const Order &order,
+                                     const std::string &timestamp) {
+  TRACE_SCOPE("db.insertOrder");
+
+  // std::lock_guard<std::mutex> lock(connectionMutex);
+
+  std::string query = "INSERT INTO user_orders (user_id, stock_name, side, "
+                      "order_type, quantity, trigger_price, timestamp) "
+                      "VALUES (?, ?, ?, ?, ?, ?, ?);";
+  sqlite3_stmt *stmt;
+
+  if (sqlite3_prepare_v2(db, query.c_str(), -1, &stmt, nullptr) == SQLITE_OK) {
+    sqlite3_bind_text(stmt, 1, order.userId.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, order.stockName.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 3, order.side == OrderSide::Buy ? "buy" : "sell",
+                      -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 4,
+                      order.type == OrderType::Limit ? "limit" : "stop", -1,
+                      SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 5, order.quantity);
+    sqlite3_bind_double(stmt, 6, order.triggerPrice);
+    sqlite3_bind_text(stmt, 7, timestamp.c_str(), -1, SQLITE_STATIC);
+
+    int result = sqlite3_step(stmt);
+
+    sqlite3_finalize(stmt);
+
+    if (result == SQLITE_DONE) {
+      return sqlite3_last_insert_rowid(db);
+    } else {
+      std::cerr << "Failed to insert order." << std::endl;
+    }
+  } else {
+    std::cerr << "Failed to prepare statement for inserting order."
+              << std::endl;
+  }
+
+  return -1;
+}
+
+bool DatabaseHandler::deleteOrder(int64_t orderId) {
+  TRACE_SCOPE("db.deleteOrder");
+
+  // std::lock_guard<std::mutex> lock(connectionMutex);
+
+  std::string query = "DELETE FROM user_orders WHERE order_id = ?";
+  sqlite3_stmt *stmt;
+
+  if (sqlite3_prepare_v2(db, query.c_str(), -1, &stmt, nullptr) == SQLITE_OK) {
+    sqlite3_bind_int64(stmt, 1, orderId);
+
+    int result = sqlite3_step(stmt);
+
+    sqlite3_finalize(stmt);
+
+    if (result == SQLITE_DONE) {
+      return sqlite3_changes(db) > 0;
+    } else {
+      std::cerr << "Failed to delete order." << std::endl;
+    }
+  } else {
+    std::cerr << "Failed to prepare statement for deleting order."
+              << std::endl;
+  }
+
+  return false;
+}
+
+static Order readOrderRow(sqlite3_stmt *stmt) {
+  Order order;
+
+  const char *userId =
+      reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1));
+  const char *stockName =
+      reinterpret_cast<const char *>(sqlite3_column_text(stmt, 2));
+  const char *side =
+      reinterpret_cast<const char *>(sqlite3_column_text(stmt, 3));
+  const char *orderType =
+      reinterpret_cast<const char *>(sqlite3_column_text(stmt, 4));
+
+  order.orderId = sqlite3_column_int64(stmt, 0);
+  order.userId = userId ? userId : "";
+  order.stockName = stockName ? stockName : "";
+  order.side = (side && std::string(side) == "sell") ? OrderSide::Sell
+                                                     : OrderSide::Buy;
+  order.type = (orderType && std::string(orderType) == "stop")
+                   ? OrderType::Stop
+                   : OrderType::Limit;
+  order.quantity = sqlite3_column_int(stmt, 5);
+  order.triggerPrice = sqlite3_column_double(stmt, 6);
+
+  return order;
+}
+
+std::vector<Order> DatabaseHandler::getOpenOrders(int64_t afterOrderId) {
+  // std::lock_guard<std::mutex> lock(connectionMutex);
+
+  std::vector<Order> orders;
+
+  std::string query = "SELECT order_id, user_id, stock_name, side, order_type, "
+                      "quantity, trigger_price FROM user_orders "
+                      "WHERE order_id > ? ORDER BY order_id";
+  sqlite3_stmt *stmt;
+
+  if (sqlite3_prepare_v2(db, query.c_str(), -1, &stmt, nullptr) == SQLITE_OK) {
+    sqlite3_bind_int64(stmt, 1, afterOrderId);
+
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+      orders.push_back(readOrderRow(stmt));
+    }
+
+    sqlite3_finalize(stmt);
+  } else {
+    std::cerr << "Failed to prepare statement for getting open orders."
+              << std::endl;
+  }
+
+  return orders;
+}
+
+std::vector<Order> DatabaseHandler::getUserOrders(const std::string &userId) {
+  TRACE_SCOPE("db.getUserOrders");
+
+  // std::lock_guard<std::mutex> lock(connectionMutex);
+
+  std::vector<Order> orders;
+
+  std::string query = "SELECT order_id, user_id, stock_name, side, order_type, "
+                      "quantity, trigger_price FROM user_orders "
+                      "WHERE user_id = ? ORDER BY order_id";
+  sqlite3_stmt *stmt;
+
+  if (sqlite3_prepare_v2(db, query.c_str(), -1, &stmt, nullptr) == SQLITE_OK) {
+    sqlite3_bind_text(stmt, 1, userId.c_str(), -1, SQLITE_STATIC);
+
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+      orders.push_back(readOrderRow(stmt));
+    }
+
+    sqlite3_finalize(stmt);
+  } else {
+    std::cerr << "Failed to prepare statement for getting user orders."
+              << std::endl;
+  }
+
+  return orders;
 }
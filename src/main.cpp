@@ -1,5 +1,8 @@
 #include <algorithm>
+#include <atomic>
 #include <cctype>
+#include <cmath>
+#include <csignal>
 #include <chrono>
 #include <cstdint>
 #include <cstdlib>
@@ -15,20 +18,86 @@
 #include <dpp/snowflake.h>
 #include <dpp/user.h>
 #include <fstream>
+#include <future>
 #include <iomanip>
 #include <ios>
 #include <jsoncpp/json/json.h>
 #include <jsoncpp/json/reader.h>
 #include <jsoncpp/json/value.h>
+#include <map>
 #include <optional>
 #include <sstream>
 #include <string>
-
+#include <thread>
+#include <utility>
+
+#include "../include/backupJob.hpp"
+#include "../include/chartRenderer.hpp"
+#include "../include/commandRegistry.hpp"
+#include "../include/costBasisBackfill.hpp"
+#include "../include/databaseExecutor.hpp"
 #include "../include/databaseHandler.hpp"
+#include "../include/orderBook.hpp"
+#include "../include/quoteCache.hpp"
+#include "../include/replyBuilder.hpp"
 #include "../include/stockRetriever.h"
+#include "../include/storageRouter.hpp"
+#include "../include/symbolDirectory.hpp"
+#include "../include/tracer.hpp"
+#include "../include/tickStore.hpp"
 
 const std::string configPath = "../data/config.json";
 const std::string dbPath = "../data/gameData.db";
+const std::string archivePath = "../data/archive.db";
+const std::string shardCatalogPath = "../data/shards.db";
+const std::string tickStorePath = "../data/ticks";
+const std::string backupPath = "../data/backups";
+const std::string commandHashPath = "../data/commands.hash";
+const std::string symbolListPath = "../data/symbols.txt";
+const std::string symbolExchange = "US";
+const std::string tracePathPrefix = "../data/trace-";
+const std::string quoteCacheName = "/stonk_market_quotes";
+
+const uint64_t orderPollSeconds = 15;
+const uint64_t tickMaintenanceSeconds = 24 * 60 * 60;
+const uint64_t quoteStatsSeconds = 60 * 60;
+const uint64_t backupSeconds = 6 * 60 * 60;
+const uint64_t ledgerArchiveSeconds = 24 * 60 * 60;
+const uint64_t symbolRefreshSeconds = 24 * 60 * 60;
+const uint64_t traceExportSeconds = 15 * 60;
+const uint64_t traceSignalPollSeconds = 5;
+const int ledgerArchiveAfterDays = 90;
+const int ledgerArchiveBatchSize = 5000;
+const int64_t tickCompactAfterDays = 7;
+const int64_t tickRetentionDays = 5 * 365;
+const size_t chartCacheEntries = 64;
+
+struct ChartRange {
+  std::string name;
+  int64_t span;
+  BarInterval interval;
+  int64_t cacheBucket;
+};
+
+const int64_t minuteMillis = static_cast<int64_t>(BarInterval::OneMinute);
+const int64_t dayMillis = static_cast<int64_t>(BarInterval::OneDay);
+
+const std::vector<ChartRange> chartRanges = {
+    {"1d", dayMillis, BarInterval::OneMinute, minuteMillis},
+    {"5d", 5 * dayMillis, BarInterval::OneMinute, 5 * minuteMillis},
+    {"1mo", 30 * dayMillis, BarInterval::FiveMinutes, 60 * minuteMillis},
+    {"6mo", 182 * dayMillis, BarInterval::OneHour, dayMillis},
+    {"1y", 365 * dayMillis, BarInterval::OneHour, dayMillis}};
+
+const size_t maxTradeLegs = 10;
+const int historyPageSize = 10;
+const int stocksPageSize = 10;
+
+struct TradeLeg {
+  OrderSide side;
+  std::string symbol;
+  int quantity;
+};
 
 std::string getBotToken() {
   std::ifstream file(configPath, std::ifstream::in);
@@ -47,6 +116,39 @@ std::string getBotToken() {
   return token;
 }
 
+double getTraceSampleRate() {
+  std::ifstream file(configPath, std::ifstream::in);
+
+  if (!file.is_open()) {
+    return TRACE_SAMPLE_RATE;
+  }
+
+  Json::Value root;
+  Json::CharReaderBuilder reader;
+  Json::parseFromStream(reader, file, &root, nullptr);
+
+  return root.get("trace_sample_rate", TRACE_SAMPLE_RATE).asDouble();
+}
+
+size_t getDatabaseShardCount() {
+  std::ifstream file(configPath, std::ifstream::in);
+
+  if (!file.is_open()) {
+    return 1;
+  }
+
+  Json::Value root;
+  Json::CharReaderBuilder reader;
+  Json::parseFromStream(reader, file, &root, nullptr);
+
+  return root.get("db_shards", 1).asUInt();
+}
+
+// Set from the SIGUSR1 handler to ask for a trace export.
+std::atomic<bool> traceRequested{false};
+
+void requestTrace(int /*signal*/) { traceRequested.store(true); }
+
 std::string getCurrentTimestamp() {
   auto now = std::chrono::system_clock::now();
 
@@ -58,30 +160,898 @@ std::string getCurrentTimestamp() {
   return ss.str();
 }
 
+std::string getTimestampDaysAgo(int days) {
+  auto then =
+      std::chrono::system_clock::now() - std::chrono::hours(24 * days);
+
+  std::time_t thenTime = std::chrono::system_clock::to_time_t(then);
+
+  std::stringstream ss;
+  ss << std::put_time(std::localtime(&thenTime), "%Y-%m-%d");
+
+  return ss.str();
+}
+
+std::string formatMoney(double value) {
+  std::ostringstream oss;
+  oss.imbue(std::locale(""));
+  oss << std::fixed << std::setprecision(2) << value;
+
+  return oss.str();
+}
+
+std::string formatSignedMoney(double value) {
+  return (value < 0.0 ? "-$" : "+$") + formatMoney(std::abs(value));
+}
+
+// Parses legs such as "buy AAPL 5, sell TSLA 2". The quantity defaults to 1.
+bool parseTradeLegs(const std::string &input, std::vector<TradeLeg> &legs) {
+  std::istringstream legStream(input);
+  std::string legString;
+
+  while (std::getline(legStream, legString, ',')) {
+    std::istringstream fieldStream(legString);
+    std::string side;
+    TradeLeg leg;
+
+    if (!(fieldStream >> side >> leg.symbol)) {
+      return false;
+    }
+
+    std::transform(side.begin(), side.end(), side.begin(), ::tolower);
+    std::transform(leg.symbol.begin(), leg.symbol.end(), leg.symbol.begin(),
+                   ::toupper);
+
+    if (side == "buy") {
+      leg.side = OrderSide::Buy;
+    } else if (side == "sell") {
+      leg.side = OrderSide::Sell;
+    } else {
+      return false;
+    }
+
+    int quantity;
+    std::string extra;
+    leg.quantity = 1;
+
+    if (fieldStream >> quantity) {
+      if (quantity <= 0) {
+        return false;
+      }
+
+      leg.quantity = quantity;
+    } else if (!fieldStream.eof()) {
+      return false;
+    }
+
+    fieldStream.clear();
+
+    if (fieldStream >> extra) {
+      return false;
+    }
+
+    legs.push_back(leg);
+  }
+
+  return !legs.empty() && legs.size() <= maxTradeLegs;
+}
+
+// Replies once the task's writes are committed, or with `failure` if the
+// batch they belong to is rolled back instead. Runs on the executor thread,
+// after the task's trace context has ended, so the reply span carries the
+// trace itself.
+void replyAfterCommit(DatabaseHandler &dbHandler,
+                      const dpp::slashcommand_t &event,
+                      const std::string &reply, const std::string &failure) {
+  dbHandler.afterCommit([event, reply, failure,
+                         traceId = currentTraceId()](bool committed) {
+    TraceContext context(traceId);
+    TRACE_SCOPE("reply");
+    event.reply(committed ? reply : failure);
+  });
+}
+
+// Runs in a savepoint so a fill that fails partway leaves nothing behind.
+bool fillOrder(DatabaseHandler &dbHandler, const Order &order, double price) {
+  bool buying = order.side == OrderSide::Buy;
+  double value = price * order.quantity * (buying ? -1.0 : 1.0);
+
+  if (!dbHandler.beginTransaction()) {
+    return false;
+  }
+
+  if (!dbHandler.updateUserBalance(order.userId, value) ||
+      !dbHandler.updateUserStock(order.userId, order.stockName,
+                                 buying ? order.quantity : -order.quantity,
+                                 price) ||
+      !dbHandler.updateTransactionsHistory(order.userId, order.stockName,
+                                           order.quantity, value,
+                                           getCurrentTimestamp())) {
+    dbHandler.rollbackTransaction();
+    return false;
+  }
+
+  return dbHandler.commitTransaction();
+}
+
+void pollOrders(dpp::cluster &bot, DatabaseExecutor &dbExecutor,
+                OrderBook &orderBook) {
+  // Pick up orders placed through other bot processes. Writers take turns
+  // on the file, so order IDs commit in increasing order and none can appear
+  // below the highest one already polled.
+  int64_t polledOrderId = orderBook.getPolledOrderId();
+  std::vector<Order> newOrders =
+      dbExecutor
+          .submit([polledOrderId](DatabaseHandler &dbHandler) {
+            return dbHandler.getOpenOrders(polledOrderId);
+          })
+          .get();
+
+  orderBook.addPolledOrders(newOrders);
+
+  for (const std::string &symbol : orderBook.getSymbols()) {
+    double price = getStockPrice(symbol);
+
+    if (price == -1.0) {
+      continue;
+    }
+
+    for (const Order &order : orderBook.onPrice(symbol, price)) {
+      dbExecutor.post([&bot, &orderBook, order,
+                       price](DatabaseHandler &dbHandler) {
+        // The order may have been cancelled through another bot process.
+        if (!dbHandler.deleteOrder(order.orderId)) {
+          return;
+        }
+
+        std::string orderString = "order #" + std::to_string(order.orderId);
+        bool filled = fillOrder(dbHandler, order, price);
+
+        dbHandler.afterCommit([&bot, &orderBook, order, orderString,
+                               filled](bool committed) {
+          if (!committed) {
+            // The order is still open in the database, so keep matching it.
+            orderBook.addOrder(order);
+            bot.log(dpp::ll_warning, "Failed to fill " + orderString + ".");
+          } else if (filled) {
+            bot.log(dpp::ll_info, "Filled " + orderString + ".");
+          } else {
+            bot.log(dpp::ll_warning, "Cancelled " + orderString +
+                                         ": insufficient funds or stock.");
+          }
+        });
+      });
+    }
+  }
+}
+
+int64_t getCurrentTimeMillis() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+void maintainTickStore(dpp::cluster &bot, TickStore &tickStore) {
+  int64_t now = getCurrentTimeMillis();
+
+  if (!tickStore.removeSegments(now - tickRetentionDays * dayMillis)) {
+    bot.log(dpp::ll_warning, "Failed to remove expired tick segments.");
+  }
+
+  if (!tickStore.compactSegments(now - tickCompactAfterDays * dayMillis)) {
+    bot.log(dpp::ll_warning, "Failed to compact tick segments.");
+  }
+}
+
+void archiveLedger(dpp::cluster &bot, DatabaseExecutor &dbExecutor) {
+  std::string cutoff = getTimestampDaysAgo(ledgerArchiveAfterDays);
+
+  int64_t throughId =
+      dbExecutor
+          .submit([cutoff](DatabaseHandler &dbHandler) {
+            return dbHandler.getLastTransactionIdBefore(cutoff);
+          })
+          .get();
+
+  int64_t archived = 0;
+  int moved;
+
+  // Each batch is a separate task so queued commands run in between.
+  do {
+    moved = dbExecutor
+                .submit(
+                    [throughId](DatabaseHandler &dbHandler) {
+                      return dbHandler.archiveTransactions(
+                          throughId, ledgerArchiveBatchSize);
+                    },
+                    false)
+                .get();
+
+    if (moved > 0) {
+      archived += moved;
+    }
+  } while (moved > 0);
+
+  if (moved < 0) {
+    bot.log(dpp::ll_warning, "Failed to archive old transactions.");
+  }
+
+  if (archived > 0) {
+    bot.log(dpp::ll_info,
+            "Archived " + std::to_string(archived) + " transactions.");
+  }
+}
+
+// Button IDs carry a keyset cursor as "<view>:<owner>:<direction>:<key>", so
+// a click can fetch the page it asks for without any state on the bot. The
+// key is the transaction ID or stock name at the edge of the current page and
+// may itself contain colons.
+struct PageCursor {
+  std::string view;
+  std::string ownerId;
+  // "o"lder or "n"ewer for history, "f"orward or "b"ack for stocks.
+  char direction = 0;
+  std::string key;
+};
+
+std::string encodePageCursor(const PageCursor &cursor) {
+  return cursor.view + ":" + cursor.ownerId + ":" + cursor.direction + ":" +
+         cursor.key;
+}
+
+bool decodePageCursor(const std::string &id, PageCursor &cursor) {
+  size_t ownerStart = id.find(':');
+  if (ownerStart == std::string::npos) {
+    return false;
+  }
+
+  size_t directionStart = id.find(':', ownerStart + 1);
+  if (directionStart == std::string::npos ||
+      directionStart + 2 >= id.size() || id[directionStart + 2] != ':') {
+    return false;
+  }
+
+  cursor.view = id.substr(0, ownerStart);
+  cursor.ownerId = id.substr(ownerStart + 1, directionStart - ownerStart - 1);
+  cursor.direction = id[directionStart + 1];
+  cursor.key = id.substr(directionStart + 3);
+
+  return true;
+}
+
+dpp::component buildPageButtons(const std::string &view,
+                                const std::string &ownerId,
+                                const std::string &previousKey,
+                                bool hasPrevious, const std::string &nextKey,
+                                bool hasNext, char previousDirection,
+                                char nextDirection) {
+  dpp::component previous;
+  previous.set_type(dpp::cot_button)
+      .set_label("Previous")
+      .set_style(dpp::cos_secondary)
+      .set_id(encodePageCursor(
+          PageCursor{view, ownerId, previousDirection, previousKey}))
+      .set_disabled(!hasPrevious);
+
+  dpp::component next;
+  next.set_type(dpp::cot_button)
+      .set_label("Next")
+      .set_style(dpp::cos_secondary)
+      .set_id(
+          encodePageCursor(PageCursor{view, ownerId, nextDirection, nextKey}))
+      .set_disabled(!hasNext);
+
+  dpp::component row;
+  row.set_type(dpp::cot_action_row).add_component(previous).add_component(next);
+
+  return row;
+}
+
+// Builds one page of history, newest first. `cursor` is the transaction ID at
+// the edge of the page being left; the first page starts above every ID.
+// `accountId` keys the rows and `userId` is the Discord user shown. Runs on
+// the executor thread.
+dpp::message buildHistoryPage(DatabaseHandler &dbHandler,
+                              const std::string &accountId,
+                              const std::string &userId, int64_t cursor,
+                              bool older) {
+  ReplyArena arena;
+
+  // One extra row tells whether there is another page in that direction.
+  std::pmr::vector<TransactionRecord> history = dbHandler.getUserHistoryPage(
+      accountId, cursor, older, historyPageSize + 1, arena.get());
+
+  bool hasOlder = !older;
+  bool hasNewer = older && cursor != INT64_MAX;
+
+  if (history.size() > static_cast<size_t>(historyPageSize)) {
+    if (older) {
+      history.pop_back();
+      hasOlder = true;
+    } else {
+      history.erase(history.begin());
+      hasNewer = true;
+    }
+  }
+
+  if (history.empty()) {
+    return dpp::message("No history to display.");
+  }
+
+  dpp::embed embed;
+  embed.set_title("Transactions").set_description("<@" + userId + ">");
+
+  std::pmr::string value(arena.get());
+
+  for (const TransactionRecord &record : history) {
+    double total = std::abs(record.value);
+    double price = total / record.quantity;
+
+    value.clear();
+    value += "Quantity: ";
+    appendInteger(value, record.quantity);
+    value += "\nPrice: $";
+    appendFixed(value, price, (price < 10.0) ? 4 : 2);
+    value += "\nTotal: $";
+    appendMoney(value, total);
+    value += " USD\nDate: ";
+    value += record.timestamp;
+
+    embed.add_field((record.value < 0.0 ? "Bought " : "Sold ") +
+                        std::string(record.stockName.data(),
+                                    record.stockName.size()),
+                    std::string(value.data(), value.size()));
+  }
+
+  dpp::message message;
+  message.add_embed(embed);
+  message.add_component(buildPageButtons(
+      "history", userId, std::to_string(history.front().transactionId),
+      hasNewer, std::to_string(history.back().transactionId), hasOlder, 'n',
+      'o'));
+
+  return message;
+}
+
+// Builds one page of open positions in ticker order. `cursor` is the ticker at
+// the edge of the page being left; the first page starts before every ticker.
+// Waits on the executor and on quotes, so it must not run on the event thread.
+dpp::message buildStocksPage(DatabaseExecutor &dbExecutor,
+                             const std::string &accountId,
+                             const std::string &userId,
+                             const std::string &cursor, bool forward) {
+  ReplyArena arena;
+
+  std::pair<std::pmr::vector<Position>, double> page =
+      dbExecutor
+          .submit([&accountId, &cursor, forward, &arena](
+                      DatabaseHandler &dbHandler) {
+            return std::make_pair(
+                dbHandler.getUserStocksPage(accountId, cursor, forward,
+                                            stocksPageSize + 1, arena.get()),
+                dbHandler.getUserRealizedPnl(accountId));
+          })
+          .get();
+
+  std::pmr::vector<Position> &positions = page.first;
+  double realizedPnl = page.second;
+
+  bool hasPrevious = forward && !cursor.empty();
+  bool hasNext = !forward;
+
+  if (positions.size() > static_cast<size_t>(stocksPageSize)) {
+    if (forward) {
+      positions.pop_back();
+      hasNext = true;
+    } else {
+      positions.erase(positions.begin());
+      hasPrevious = true;
+    }
+  }
+
+  if (positions.empty() && realizedPnl == 0.0) {
+    return dpp::message("No stocks to display.");
+  }
+
+  dpp::embed embed;
+  embed.set_title("Stocks").set_description("<@" + userId + ">");
+
+  // Price the whole page at once instead of one quote after another.
+  // Display only, so the last price seen stands in while Finnhub is down.
+  std::vector<std::future<std::pair<double, bool>>> prices;
+
+  for (const Position &position : positions) {
+    prices.push_back(std::async(std::launch::async, [&position]() {
+      Quote quote;
+      bool stale = false;
+
+      if (!getQuote(position.stockName, quote, &stale)) {
+        return std::make_pair(-1.0, false);
+      }
+
+      return std::make_pair(quote.price, stale);
+    }));
+  }
+
+  std::pmr::string value(arena.get());
+
+  for (size_t i = 0; i < positions.size(); i++) {
+    const Position &position = positions[i];
+
+    value.clear();
+    value += "Quantity: ";
+    appendInteger(value, position.quantity);
+    value += "\nAverage Cost: $";
+    appendMoney(value, position.averageCost);
+
+    std::pair<double, bool> pricing = prices[i].get();
+    double price = pricing.first;
+
+    if (price != -1.0) {
+      double costBasis = position.averageCost * position.quantity;
+      double unrealizedPnl = price * position.quantity - costBasis;
+
+      value += "\nUnrealized P&L: ";
+      appendSignedMoney(value, unrealizedPnl);
+
+      if (costBasis > 0.0) {
+        value += unrealizedPnl < 0.0 ? " (" : " (+";
+        appendFixed(value, unrealizedPnl / costBasis * 100.0, 2);
+        value += "%)";
+      }
+
+      if (pricing.second) {
+        value += " (delayed)";
+      }
+    }
+
+    embed.add_field(position.stockName,
+                    std::string(value.data(), value.size()));
+  }
+
+  value.clear();
+  value += "Realized P&L: ";
+  appendSignedMoney(value, realizedPnl);
+  embed.set_footer(std::string(value.data(), value.size()), "");
+
+  dpp::message message;
+  message.add_embed(embed);
+
+  if (!positions.empty()) {
+    message.add_component(buildPageButtons(
+        "stocks", userId, positions.front().stockName, hasPrevious,
+        positions.back().stockName, hasNext, 'b', 'f'));
+  }
+
+  return message;
+}
+
+// Replaces a deferred response with a page of stocks, built on its own thread
+// since pricing a page can outlast the time Discord allows for a first reply.
+template <typename Event>
+void editWithStocksPage(DatabaseExecutor &dbExecutor, const Event &event,
+                        const std::string &accountId, const std::string &userId,
+                        const std::string &cursor, bool forward) {
+  std::thread([&dbExecutor, event, accountId, userId, cursor, forward,
+               traceId = currentTraceId()]() {
+    TraceContext context(traceId);
+    event.edit_response(
+        buildStocksPage(dbExecutor, accountId, userId, cursor, forward));
+  }).detach();
+}
+
+// Renders `symbol` over `range`, or reuses a chart cached for the same
+// window. Checks the ticker upstream, so it must not run on the event thread.
+dpp::message buildChartMessage(TickStore &tickStore, ChartCache &chartCache,
+                               const std::string &symbol,
+                               const ChartRange &range) {
+  int64_t now = getCurrentTimeMillis();
+  std::string cacheKey = symbol + "|" + range.name + "|" +
+                         std::to_string(now / range.cacheBucket);
+  std::string image;
+
+  if (!chartCache.get(cacheKey, image)) {
+    if (getStockPrice(symbol) == -1.0) {
+      return dpp::message("Invalid ticker.");
+    }
+
+    std::vector<Bar> bars =
+        tickStore.getBars(symbol, now - range.span, now + 1, range.interval);
+
+    if (bars.size() < 2) {
+      return dpp::message("Not enough price history for " + symbol + " yet.");
+    }
+
+    image = renderChartPng(downsampleBars(bars, CHART_WIDTH), CHART_WIDTH,
+                           CHART_HEIGHT);
+
+    if (image.empty()) {
+      return dpp::message("Failed to render chart.");
+    }
+
+    chartCache.put(cacheKey, image);
+  }
+
+  dpp::message message("## " + symbol + " (" + range.name + ")");
+  message.add_file(symbol + ".png", image);
+
+  return message;
+}
+
+// Replaces a deferred response with a chart, built on its own thread like a
+// page of stocks.
+template <typename Event>
+void editWithChart(TickStore &tickStore, ChartCache &chartCache,
+                   const Event &event, const std::string &symbol,
+                   const ChartRange &range) {
+  std::thread([&tickStore, &chartCache, event, symbol, range,
+               traceId = currentTraceId()]() {
+    TraceContext context(traceId);
+    event.edit_response(
+        buildChartMessage(tickStore, chartCache, symbol, range));
+  }).detach();
+}
+
+// The primary cluster downloads the list and rewrites the cache file; the
+// others pick up the file it wrote.
+void refreshSymbolDirectory(dpp::cluster &bot, SymbolDirectory &directory,
+                            bool primaryCluster) {
+  if (!primaryCluster) {
+    directory.reload();
+    return;
+  }
+
+  std::vector<std::string> symbols;
+
+  if (!getExchangeSymbols(symbolExchange, symbols) ||
+      !directory.store(std::move(symbols))) {
+    bot.log(dpp::ll_warning, "Failed to refresh the symbol list.");
+  }
+}
+
+std::vector<dpp::slashcommand>
+buildSlashCommands(const dpp::snowflake &applicationId) {
+  dpp::slashcommand stockinfocommand(
+      "stockinfo", "Retrieves data for a stock.", applicationId);
+  stockinfocommand.add_option(
+      dpp::command_option(dpp::co_string, "ticker", "The ticker for the stock",
+                          true)
+          .set_auto_complete(true));
+
+  dpp::command_option rangeoption(dpp::co_string, "range",
+                                  "The time range to chart", false);
+  for (const auto &range : chartRanges) {
+    rangeoption.add_choice(dpp::command_option_choice(range.name, range.name));
+  }
+
+  dpp::slashcommand chartcommand("chart", "Displays a price chart.",
+                                 applicationId);
+  chartcommand
+      .add_option(dpp::command_option(dpp::co_string, "ticker",
+                                      "The ticker for the stock", true)
+                      .set_auto_complete(true))
+      .add_option(rangeoption);
+
+  dpp::slashcommand balancecommand("balance", "Displays your balance.",
+                                   applicationId);
+
+  dpp::slashcommand buycommand("buy", "Purchase stocks.", applicationId);
+  buycommand
+      .add_option(dpp::command_option(dpp::co_string, "ticker",
+                                      "The ticker for the stock", true)
+                      .set_auto_complete(true))
+      .add_option(dpp::command_option(dpp::co_integer, "quantity",
+                                      "The amount of stocks to buy", true));
+
+  dpp::slashcommand sellcommand("sell", "Sell your stocks.", applicationId);
+  sellcommand
+      .add_option(dpp::command_option(dpp::co_string, "ticker",
+                                      "The ticker for the stock", true)
+                      .set_auto_complete(true))
+      .add_option(dpp::command_option(dpp::co_integer, "quantity",
+                                      "The amount of stocks to sell",
+                                      true));
+
+  dpp::slashcommand tradecommand(
+      "trade", "Buy and sell several stocks at once.", applicationId);
+  tradecommand.add_option(dpp::command_option(
+      dpp::co_string, "orders",
+      "Comma-separated orders, e.g. \"buy AAPL 5, sell TSLA 2\"", true));
+
+  dpp::command_option sideoption(dpp::co_string, "side",
+                                 "Whether to buy or sell", true);
+  sideoption
+      .add_choice(dpp::command_option_choice("Buy", std::string("buy")))
+      .add_choice(dpp::command_option_choice("Sell", std::string("sell")));
+
+  dpp::slashcommand limitcommand("limit", "Place a limit order.",
+                                 applicationId);
+  limitcommand.add_option(sideoption)
+      .add_option(dpp::command_option(dpp::co_string, "ticker",
+                                      "The ticker for the stock", true)
+                      .set_auto_complete(true))
+      .add_option(dpp::command_option(dpp::co_integer, "quantity",
+                                      "The amount of stocks to trade",
+                                      true))
+      .add_option(dpp::command_option(dpp::co_number, "price",
+                                      "The limit price", true));
+
+  dpp::slashcommand stopcommand("stop", "Place a stop order.", applicationId);
+  stopcommand.add_option(sideoption)
+      .add_option(dpp::command_option(dpp::co_string, "ticker",
+                                      "The ticker for the stock", true)
+                      .set_auto_complete(true))
+      .add_option(dpp::command_option(dpp::co_integer, "quantity",
+                                      "The amount of stocks to trade",
+                                      true))
+      .add_option(dpp::command_option(dpp::co_number, "price",
+                                      "The stop price", true));
+
+  dpp::slashcommand orderscommand("orders", "Displays your open orders.",
+                                  applicationId);
+
+  dpp::slashcommand cancelcommand("cancel", "Cancel an open order.",
+                                  applicationId);
+  cancelcommand.add_option(dpp::command_option(
+      dpp::co_integer, "order", "The number of the order", true));
+
+  dpp::slashcommand getstockscommand("stocks", "Displays your stocks.",
+                                     applicationId);
+
+  dpp::slashcommand historycommand(
+      "history", "Displays your past transactions.", applicationId);
+
+  dpp::slashcommand helpcommand("help", "Displays a list of commands.",
+                                applicationId);
+
+  return {stockinfocommand, chartcommand,   balancecommand,   buycommand,
+          sellcommand,      tradecommand,   limitcommand,     stopcommand,
+          orderscommand,    cancelcommand,  getstockscommand, historycommand,
+          helpcommand};
+}
+
 int main(int argc, char *argv[]) {
-  DatabaseHandler dbHandler(dbPath);
-  dbHandler.createTables();
+  // Every process owns the shards where shard_id % clusters == clusterId.
+  // Host-wide jobs run only in cluster 0.
+  uint32_t clusterId = 0;
+  uint32_t clusterCount = 1;
+  uint32_t shardCount = 0;
+  std::string restorePath;
+  uint32_t restoreShard = 0;
+  std::string moveGuild;
+  std::string splitDatabaseShard;
+  std::string legacyGuild;
+
+  for (int i = 1; i + 1 < argc; i += 2) {
+    std::string flag = argv[i];
+    uint32_t value =
+        static_cast<uint32_t>(std::strtoul(argv[i + 1], nullptr, 10));
+
+    if (flag == "--restore") {
+      restorePath = argv[i + 1];
+    } else if (flag == "--restore-shard") {
+      restoreShard = value;
+    } else if (flag == "--move-guild") {
+      moveGuild = argv[i + 1];
+    } else if (flag == "--split-db-shard") {
+      splitDatabaseShard = argv[i + 1];
+    } else if (flag == "--adopt-legacy-guild") {
+      legacyGuild = argv[i + 1];
+    } else if (flag == "--cluster") {
+      clusterId = value;
+    } else if (flag == "--clusters") {
+      clusterCount = value;
+    } else if (flag == "--shards") {
+      shardCount = value;
+    } else {
+      std::cerr << "Unknown option: " << flag << std::endl;
+      return 1;
+    }
+  }
+
+  if (clusterCount == 0 || clusterId >= clusterCount) {
+    std::cerr << "Invalid cluster configuration." << std::endl;
+    return 1;
+  }
+
+  bool primaryCluster = (clusterId == 0);
+
+  // Restoring replaces the database file, so it has to happen before the
+  // executor opens it, and not while another bot process has it open.
+  // Backups are per shard; --restore-shard picks which one (0 by default).
+  if (!restorePath.empty()) {
+    if (restoreShard >= std::max<size_t>(getDatabaseShardCount(), 1)) {
+      std::cerr << "Invalid shard to restore." << std::endl;
+      return 1;
+    }
+
+    std::string shardDbPath = StorageRouter::getShardPath(dbPath, restoreShard);
+    ShardLock lock(shardDbPath, true);
+
+    if (!lock.isHeld()) {
+      std::cerr << "Stop every bot process before restoring." << std::endl;
+      return 1;
+    }
+
+    if (!BackupJob::restore(
+            restorePath, shardDbPath,
+            StorageRouter::getShardPath(archivePath, restoreShard))) {
+      return 1;
+    }
+
+    std::cout << "Restored shard " << restoreShard << " from " << restorePath
+              << std::endl;
+  }
+
+  StorageRouter storage(shardCatalogPath, dbPath, archivePath,
+                        getDatabaseShardCount());
+
+  if (!storage.isOpen()) {
+    return 1;
+  }
+
+  // The tools below rewrite shards in place, so they need them to
+  // themselves; a bot process only has to keep them from running.
+  bool rewritingShards =
+      !legacyGuild.empty() || !moveGuild.empty() || !splitDatabaseShard.empty();
+
+  if (!storage.lockShards(rewritingShards)) {
+    std::cerr << (rewritingShards
+                      ? "Stop every bot process before rebalancing."
+                      : "Shards are being rebalanced or restored.")
+              << std::endl;
+    return 1;
+  }
+
+  std::vector<bool> archiveAttached;
+  std::vector<std::unique_ptr<BackupJob>> backupJobs;
+
+  for (size_t i = 0; i < storage.size(); i++) {
+    StorageShard &shard = storage.getShard(i);
+    DatabaseExecutor &dbExecutor = *shard.executor;
+
+    bool tablesCreated =
+        dbExecutor
+            .submit([](DatabaseHandler &dbHandler) {
+              return dbHandler.createTables();
+            })
+            .get();
+
+    if (!tablesCreated) {
+      std::cerr << "Failed to prepare " << shard.dbPath << "." << std::endl;
+      return 1;
+    }
+
+    if (!backfillCostBasis(dbExecutor, shard.dbPath)) {
+      return 1;
+    }
+
+    std::string shardArchivePath = shard.archivePath;
+
+    archiveAttached.push_back(
+        dbExecutor
+            .submit(
+                [shardArchivePath](DatabaseHandler &dbHandler) {
+                  return dbHandler.attachArchive(shardArchivePath);
+                },
+                false)
+            .get());
+
+    std::vector<Order> openOrders =
+        dbExecutor
+            .submit([](DatabaseHandler &dbHandler) {
+              return dbHandler.getOpenOrders(0);
+            })
+            .get();
+
+    shard.orderBook.addPolledOrders(openOrders);
+
+    backupJobs.push_back(std::make_unique<BackupJob>(
+        dbExecutor, StorageRouter::getShardPath(backupPath, i)));
+  }
+
+  // Rebalancing runs against the shards and exits without starting the bot.
+  // New shards are added by raising db_shards first; both tools move guilds
+  // to the last shard.
+  if (!legacyGuild.empty()) {
+    bool success = storage.adoptLegacyAccounts(
+        std::strtoull(legacyGuild.c_str(), nullptr, 10));
+
+    std::cout << (success ? "Adopted legacy accounts."
+                          : "Adopting legacy accounts failed.")
+              << std::endl;
+    return success ? 0 : 1;
+  }
+
+  if (!moveGuild.empty() || !splitDatabaseShard.empty()) {
+    size_t lastShard = storage.size() - 1;
+    bool success;
+
+    if (!moveGuild.empty()) {
+      size_t separator = moveGuild.find(':');
+      uint64_t guildId = std::strtoull(moveGuild.c_str(), nullptr, 10);
+      size_t toShard = lastShard;
+
+      if (separator != std::string::npos) {
+        toShard = std::strtoul(moveGuild.c_str() + separator + 1, nullptr, 10);
+      }
+
+      success = storage.moveGuild(guildId, toShard);
+    } else {
+      success = storage.splitShard(
+          std::strtoul(splitDatabaseShard.c_str(), nullptr, 10), lastShard);
+    }
+
+    std::cout << (success ? "Rebalanced shards." : "Rebalancing failed.")
+              << std::endl;
+    return success ? 0 : 1;
+  }
+
+  TickStore tickStore(tickStorePath);
+  ChartCache chartCache(chartCacheEntries);
+
+  setPriceListener([&tickStore](const std::string &symbol, double price) {
+    tickStore.appendTick(symbol, getCurrentTimeMillis(), price);
+  });
+
+  QuoteCache quoteCache(quoteCacheName);
+  setQuoteCache(&quoteCache);
+
+  // Loaded before the bot starts so tickers are checked from the first
+  // command. Only a missing or stale cache is downloaded here.
+  SymbolDirectory symbolDirectory(symbolListPath);
+  int64_t symbolListAge = symbolDirectory.getCacheAgeSeconds();
+
+  if (primaryCluster &&
+      (symbolListAge < 0 ||
+       symbolListAge > static_cast<int64_t>(symbolRefreshSeconds))) {
+    std::vector<std::string> symbols;
+
+    if (getExchangeSymbols(symbolExchange, symbols)) {
+      symbolDirectory.store(std::move(symbols));
+    }
+  }
+
+  if (!symbolDirectory.isLoaded() && !symbolDirectory.reload()) {
+    std::cerr << "Symbol list unavailable; tickers will not be checked."
+              << std::endl;
+  }
+
+  setSymbolDirectory(&symbolDirectory);
+  setTraceSampleRate(getTraceSampleRate());
 
-  dpp::cluster bot(getBotToken());
+  dpp::cluster bot(getBotToken(), dpp::i_default_intents, shardCount,
+                   clusterId, clusterCount);
 
   bot.on_log(dpp::utility::cout_logger());
 
-  bot.on_slashcommand([&bot, &dbHandler](const dpp::slashcommand_t &event) {
+  bot.on_slashcommand([&bot, &storage, &tickStore,
+                       &chartCache](const dpp::slashcommand_t &event) {
+    TraceInteraction trace(event.command.get_command_name());
     dpp::user user = event.command.get_issuing_user();
 
+    // Every guild is its own economy on one database shard; direct messages
+    // share the global one.
+    StorageShard &shard = storage.getShardForGuild(event.command.guild_id);
+    DatabaseExecutor &dbExecutor = *shard.executor;
+    std::string accountId =
+        StorageRouter::getAccountId(event.command.guild_id, user.id);
+
     if (event.command.get_command_name() == "stockinfo") {
       std::string symbol = std::get<std::string>(event.get_parameter("ticker"));
       std::transform(symbol.begin(), symbol.end(), symbol.begin(), ::toupper);
 
-      double price = getStockPrice(symbol);
+      Quote quote;
+      bool stale = false;
 
-      if (price == -1.0) {
+      if (!getQuote(symbol, quote, &stale) || quote.price == -1.0) {
         event.reply("Invalid ticker.");
         return;
       }
 
-      double change = getChange(symbol);
-      double percentChange = getPercentChange(symbol);
+      double price = quote.price;
+      double change = quote.change;
+      double percentChange = quote.percentChange;
 
       std::ostringstream oss;
       oss.imbue(std::locale(""));
@@ -115,61 +1085,70 @@ int main(int argc, char *argv[]) {
                   << percentChangeString << "%) "
                   << (percentChange < 0.0 ? "↓" : "↑");
 
+      if (stale) {
+        replyStream << "\n-# Finnhub is unavailable; this is the last price "
+                       "seen.";
+      }
+
       std::string reply = replyStream.str();
 
       event.reply(reply);
     }
 
-    if (event.command.get_command_name() == "stocks") {
-      std::vector<std::pair<std::string, int>> stocks =
-          dbHandler.getUserStocks(user.id.str());
-
-      std::ostringstream replyStream;
-      replyStream << "## <@" << user.id.str() << ">'s Stocks:";
-
-      int stockCount = 0;
-      for (const auto &stock : stocks) {
-        if (stock.second == 0) {
-          continue;
-        }
-
-        std::string symbol = stock.first;
-        int quantity = stock.second;
-
-        std::ostringstream oss;
-        oss.imbue(std::locale(""));
-
-        oss << quantity;
+    if (event.command.get_command_name() == "chart") {
+      std::string symbol = std::get<std::string>(event.get_parameter("ticker"));
+      std::transform(symbol.begin(), symbol.end(), symbol.begin(), ::toupper);
 
-        replyStream << "\n> **Stock: " << symbol
-                    << "**\n> - Quantity: " << oss.str();
+      dpp::command_value rangeParameter = event.get_parameter("range");
+      std::string rangeName = "1d";
 
-        stockCount++;
+      if (std::holds_alternative<std::string>(rangeParameter)) {
+        rangeName = std::get<std::string>(rangeParameter);
       }
 
-      if (stockCount == 0) {
-        event.reply("No stocks to display.");
+      auto range = std::find_if(
+          chartRanges.begin(), chartRanges.end(),
+          [&rangeName](const ChartRange &r) { return r.name == rangeName; });
+
+      if (range == chartRanges.end()) {
+        event.reply("Invalid range.");
         return;
       }
 
-      std::string reply = replyStream.str();
+      event.thinking(false, [&tickStore, &chartCache, event, symbol,
+                             range = *range](
+                                const dpp::confirmation_callback_t &callback) {
+        if (!callback.is_error()) {
+          editWithChart(tickStore, chartCache, event, symbol, range);
+        }
+      });
+    }
 
-      event.reply(reply);
+    if (event.command.get_command_name() == "stocks") {
+      event.thinking(false, [&dbExecutor, event, accountId,
+                             userId = user.id.str()](
+                                const dpp::confirmation_callback_t &callback) {
+        if (!callback.is_error()) {
+          editWithStocksPage(dbExecutor, event, accountId, userId, "", true);
+        }
+      });
     }
 
     if (event.command.get_command_name() == "balance") {
-      double balance = dbHandler.getUserBalance(user.id.str());
+      dbExecutor.post([event, user, accountId](DatabaseHandler &dbHandler) {
+        double balance = dbHandler.getUserBalance(accountId);
 
-      std::ostringstream oss;
-      oss.imbue(std::locale(""));
-      oss << std::fixed << std::setprecision(2) << balance;
-      std::string balanceString = oss.str();
+        std::ostringstream oss;
+        oss.imbue(std::locale(""));
+        oss << std::fixed << std::setprecision(2) << balance;
+        std::string balanceString = oss.str();
 
-      std::ostringstream replyStream;
-      replyStream << "## <@" << user.id.str() << ">'s Balance:\n> $"
-                  << balanceString;
+        std::ostringstream replyStream;
+        replyStream << "## <@" << user.id.str() << ">'s Balance:\n> $"
+                    << balanceString;
 
-      event.reply(replyStream.str());
+        event.reply(replyStream.str());
+      });
     }
 
     if (event.command.get_command_name() == "buy") {
@@ -197,39 +1176,51 @@ int main(int argc, char *argv[]) {
         return;
       }
 
-      double balance = dbHandler.getUserBalance(user.id.str());
+      dbExecutor.post([event, accountId, symbol, quantity,
+                       price](DatabaseHandler &dbHandler) {
+        double balance = dbHandler.getUserBalance(accountId);
 
-      if (price * quantity > balance) {
-        event.reply("Insufficient funds.");
-        return;
-      }
+        if (price * quantity > balance) {
+          event.reply("Insufficient funds.");
+          return;
+        }
 
-      std::ostringstream oss;
-      oss.imbue(std::locale(""));
-      oss << quantity;
+        std::ostringstream oss;
+        oss.imbue(std::locale(""));
+        oss << quantity;
 
-      std::string quantityString = oss.str();
+        std::string quantityString = oss.str();
 
-      oss.str("");
+        oss.str("");
 
-      oss << std::fixed << std::setprecision(2) << (price * quantity);
+        oss << std::fixed << std::setprecision(2) << (price * quantity);
 
-      std::string priceString = oss.str();
+        std::string priceString = oss.str();
 
-      std::ostringstream replyStream;
-      replyStream << "Successfully purchased **" << quantityString << " "
-                  << symbol << "** stock" << (quantity > 1 ? "s" : "")
-                  << " for **$" << priceString << "**.";
+        std::ostringstream replyStream;
+        replyStream << "Successfully purchased **" << quantityString << " "
+                    << symbol << "** stock" << (quantity > 1 ? "s" : "")
+                    << " for **$" << priceString << "**.";
 
-      if (dbHandler.updateUserBalance(user.id.str(), price * quantity * -1.0)) {
-        if (dbHandler.updateUserStock(user.id.str(), symbol, quantity)) {
-          event.reply(replyStream.str());
+        if (!dbHandler.beginTransaction()) {
+          event.reply("Purchase failed.");
+          return;
         }
 
-        dbHandler.updateTransactionsHistory(user.id.str(), symbol, quantity,
-                                            price * quantity * -1.0,
-                                            getCurrentTimestamp());
-      }
+        if (!dbHandler.updateUserBalance(accountId, price * quantity * -1.0) ||
+            !dbHandler.updateUserStock(accountId, symbol, quantity, price) ||
+            !dbHandler.updateTransactionsHistory(accountId, symbol, quantity,
+                                                 price * quantity * -1.0,
+                                                 getCurrentTimestamp()) ||
+            !dbHandler.commitTransaction()) {
+          dbHandler.rollbackTransaction();
+          event.reply("Purchase failed.");
+          return;
+        }
+
+        replyAfterCommit(dbHandler, event, replyStream.str(),
+                         "Purchase failed.");
+      });
     }
 
     if (event.command.get_command_name() == "sell") {
@@ -239,115 +1230,431 @@ int main(int argc, char *argv[]) {
       std::optional<int64_t> quantityOptional =
           std::get<int64_t>(event.get_parameter("quantity"));
 
-      int userQuantity = dbHandler.getUserStockQuantity(user.id.str(), symbol);
-      int quantity = 1;
+      double price = getStockPrice(symbol);
 
-      if (quantityOptional.has_value()) {
-        if (quantityOptional.value() <= 0 || quantity > userQuantity) {
-          event.reply("Invalid quantity.");
+      if (price == -1.0) {
+        event.reply("Invalid ticker.");
+        return;
+      }
+
+      dbExecutor.post([event, accountId, symbol, quantityOptional,
+                       price](DatabaseHandler &dbHandler) {
+        int userQuantity = dbHandler.getUserStockQuantity(accountId, symbol);
+        int quantity = 1;
+
+        if (quantityOptional.has_value()) {
+          if (quantityOptional.value() <= 0 || quantity > userQuantity) {
+            event.reply("Invalid quantity.");
+            return;
+          }
+
+          quantity = static_cast<int>(quantityOptional.value());
+        }
+
+        double balance = dbHandler.getUserBalance(accountId);
+
+        std::ostringstream oss;
+        oss.imbue(std::locale(""));
+        oss << quantity;
+
+        std::string quantityString = oss.str();
+
+        oss.str("");
+
+        oss << std::fixed << std::setprecision(2) << (price * quantity);
+
+        std::string priceString = oss.str();
+
+        std::ostringstream replyStream;
+        replyStream << "Successfully sold **" << quantityString << " " << symbol
+                    << "** stock" << (quantity > 1 ? "s" : "") << " for **$"
+                    << priceString << "**.";
+
+        if (!dbHandler.beginTransaction()) {
+          event.reply("Sale failed.");
           return;
         }
 
-        quantity = static_cast<int>(quantityOptional.value());
+        if (!dbHandler.updateUserStock(accountId, symbol, quantity * -1,
+                                       price) ||
+            !dbHandler.updateUserBalance(accountId, price * quantity) ||
+            !dbHandler.updateTransactionsHistory(accountId, symbol, quantity,
+                                                 price * quantity,
+                                                 getCurrentTimestamp()) ||
+            !dbHandler.commitTransaction()) {
+          dbHandler.rollbackTransaction();
+          event.reply("Sale failed.");
+          return;
+        }
+
+        replyAfterCommit(dbHandler, event, replyStream.str(), "Sale failed.");
+      });
+    }
+
+    if (event.command.get_command_name() == "trade") {
+      auto started = std::chrono::steady_clock::now();
+
+      std::vector<TradeLeg> legs;
+
+      if (!parseTradeLegs(std::get<std::string>(event.get_parameter("orders")),
+                          legs)) {
+        event.reply("Invalid orders. Use up to " +
+                    std::to_string(maxTradeLegs) +
+                    " orders like `buy AAPL 5, sell TSLA 2`.");
+        return;
       }
 
-      double price = getStockPrice(symbol);
+      // Price every symbol at once; each fetch also reports its own time so
+      // the log shows how much fetch time ran in parallel. That sum covers
+      // quotes only, not the commit each order would need on its own.
+      std::map<std::string, std::future<std::pair<double, int64_t>>> pricing;
 
-      if (price == -1.0) {
-        event.reply("Invalid ticker.");
+      for (const TradeLeg &leg : legs) {
+        if (pricing.count(leg.symbol)) {
+          continue;
+        }
+
+        pricing[leg.symbol] = std::async(
+            std::launch::async, [symbol = leg.symbol]() {
+              auto fetchStarted = std::chrono::steady_clock::now();
+              double price = getStockPrice(symbol);
+
+              return std::make_pair(
+                  price, static_cast<int64_t>(
+                             std::chrono::duration_cast<
+                                 std::chrono::milliseconds>(
+                                 std::chrono::steady_clock::now() -
+                                 fetchStarted)
+                                 .count()));
+            });
       }
 
-      double balance = dbHandler.getUserBalance(user.id.str());
+      std::map<std::string, double> prices;
+      int64_t summedFetchMillis = 0;
 
-      std::ostringstream oss;
-      oss.imbue(std::locale(""));
-      oss << quantity;
+      for (auto &symbolPricing : pricing) {
+        std::pair<double, int64_t> result = symbolPricing.second.get();
 
-      std::string quantityString = oss.str();
+        prices[symbolPricing.first] = result.first;
+        summedFetchMillis += result.second;
+      }
 
-      oss.str("");
+      int64_t pricingMillis =
+          std::chrono::duration_cast<std::chrono::milliseconds>(
+              std::chrono::steady_clock::now() - started)
+              .count();
+
+      for (const auto &price : prices) {
+        if (price.second == -1.0) {
+          event.reply("Invalid ticker: " + price.first + ".");
+          return;
+        }
+      }
 
-      oss << std::fixed << std::setprecision(2) << (price * quantity);
+      dbExecutor.post([&bot, event, user, accountId, legs, prices, started,
+                       pricingMillis,
+                       summedFetchMillis](DatabaseHandler &dbHandler) {
+        // Check the legs in order against the current balance and holdings
+        // before anything is written.
+        double balance = dbHandler.getUserBalance(accountId);
+        std::map<std::string, int> holdings;
+
+        for (size_t i = 0; i < legs.size(); i++) {
+          const TradeLeg &leg = legs[i];
+          double value = prices.at(leg.symbol) * leg.quantity;
+
+          if (!holdings.count(leg.symbol)) {
+            holdings[leg.symbol] =
+                dbHandler.getUserStockQuantity(accountId, leg.symbol);
+          }
+
+          if (leg.side == OrderSide::Buy) {
+            holdings[leg.symbol] += leg.quantity;
+            balance -= value;
+
+            if (balance < 0.0) {
+              event.reply("Insufficient funds for order " +
+                          std::to_string(i + 1) + ". No orders were placed.");
+              return;
+            }
+          } else {
+            holdings[leg.symbol] -= leg.quantity;
+            balance += value;
+
+            if (holdings[leg.symbol] < 0) {
+              event.reply("Not enough " + leg.symbol + " to sell in order " +
+                          std::to_string(i + 1) + ". No orders were placed.");
+              return;
+            }
+          }
+        }
 
-      std::string priceString = oss.str();
+        if (!dbHandler.beginTransaction()) {
+          event.reply("Trade failed. No orders were placed.");
+          return;
+        }
 
-      std::ostringstream replyStream;
-      replyStream << "Successfully sold **" << quantityString << " " << symbol
-                  << "** stock" << (quantity > 1 ? "s" : "") << " for **$"
-                  << priceString << "**.";
+        std::string timestamp = getCurrentTimestamp();
+        std::ostringstream replyStream;
+        replyStream << "## <@" << user.id.str() << ">'s Trade:";
+
+        double netValue = 0.0;
+
+        for (const TradeLeg &leg : legs) {
+          bool buying = leg.side == OrderSide::Buy;
+          double price = prices.at(leg.symbol);
+          double value = price * leg.quantity * (buying ? -1.0 : 1.0);
+
+          if (!dbHandler.updateUserBalance(accountId, value) ||
+              !dbHandler.updateUserStock(accountId, leg.symbol,
+                                         buying ? leg.quantity
+                                                : -leg.quantity,
+                                         price) ||
+              !dbHandler.updateTransactionsHistory(accountId, leg.symbol,
+                                                   leg.quantity, value,
+                                                   timestamp)) {
+            dbHandler.rollbackTransaction();
+            event.reply("Trade failed. No orders were placed.");
+            return;
+          }
+
+          netValue += value;
+
+          std::ostringstream oss;
+          oss.imbue(std::locale(""));
+          oss << leg.quantity;
+
+          replyStream << "\n> " << (buying ? "Bought" : "Sold") << " **"
+                      << oss.str() << " " << leg.symbol << "** for **$"
+                      << formatMoney(std::abs(value)) << "**";
+        }
 
-      if (dbHandler.updateUserStock(user.id.str(), symbol, quantity * -1)) {
-        if (dbHandler.updateUserBalance(user.id.str(), price * quantity)) {
-          event.reply(replyStream.str());
+        if (!dbHandler.commitTransaction()) {
+          dbHandler.rollbackTransaction();
+          event.reply("Trade failed. No orders were placed.");
+          return;
         }
 
-        dbHandler.updateTransactionsHistory(user.id.str(), symbol, quantity,
-                                            price * quantity,
-                                            getCurrentTimestamp());
-      }
+        replyStream << "\n> **Net: " << formatSignedMoney(netValue) << "**";
+
+        replyAfterCommit(dbHandler, event, replyStream.str(),
+                         "Trade failed. No orders were placed.");
+
+        int64_t totalMillis =
+            std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - started)
+                .count();
+
+        bot.log(dpp::ll_debug,
+                "Trade of " + std::to_string(legs.size()) + " orders took " +
+                    std::to_string(totalMillis) + " ms; pricing took " +
+                    std::to_string(pricingMillis) + " ms for " +
+                    std::to_string(prices.size()) + " quotes whose fetches "
+                    "took " + std::to_string(summedFetchMillis) +
+                    " ms in total.");
+      });
     }
 
     if (event.command.get_command_name() == "history") {
-      std::vector<std::vector<std::string>> history =
-          dbHandler.getUserHistory(user.id.str());
+      dbExecutor.post([event, user, accountId](DatabaseHandler &dbHandler) {
+        event.reply(buildHistoryPage(dbHandler, accountId, user.id.str(),
+                                     INT64_MAX, true));
+      });
+    }
 
-      if (history.size() == 0) {
-        event.reply("No history to display.");
+    if (event.command.get_command_name() == "limit" ||
+        event.command.get_command_name() == "stop") {
+      std::string side = std::get<std::string>(event.get_parameter("side"));
+      std::string symbol = std::get<std::string>(event.get_parameter("ticker"));
+      std::transform(symbol.begin(), symbol.end(), symbol.begin(), ::toupper);
+
+      int64_t quantity = std::get<int64_t>(event.get_parameter("quantity"));
+      double triggerPrice = std::get<double>(event.get_parameter("price"));
+
+      if (quantity <= 0) {
+        event.reply("Invalid quantity.");
         return;
       }
 
-      std::ostringstream replyStream;
-      replyStream << "## <@" << user.id.str() << ">'s Transactions:";
+      if (triggerPrice <= 0.0) {
+        event.reply("Invalid price.");
+        return;
+      }
+
+      if (getStockPrice(symbol) == -1.0) {
+        event.reply("Invalid ticker.");
+        return;
+      }
+
+      Order order;
+      order.userId = accountId;
+      order.stockName = symbol;
+      order.side = (side == "sell") ? OrderSide::Sell : OrderSide::Buy;
+      order.type = (event.command.get_command_name() == "stop")
+                       ? OrderType::Stop
+                       : OrderType::Limit;
+      order.quantity = static_cast<int>(quantity);
+      order.triggerPrice = triggerPrice;
+
+      dbExecutor.post([event, order, symbol, triggerPrice,
+                       &orderBook = shard.orderBook](
+                          DatabaseHandler &dbHandler) mutable {
+        if (order.side == OrderSide::Buy &&
+            triggerPrice * order.quantity >
+                dbHandler.getUserBalance(order.userId)) {
+          event.reply("Insufficient funds.");
+          return;
+        }
 
-      int count = 1;
-      for (auto &values : history) {
-        int quantity = std::stoi(values[1]);
-        double value = std::abs(std::stod(values[2]));
-        double price = value / quantity;
+        if (order.side == OrderSide::Sell &&
+            order.quantity >
+                dbHandler.getUserStockQuantity(order.userId, symbol)) {
+          event.reply("Invalid quantity.");
+          return;
+        }
+
+        order.orderId = dbHandler.insertOrder(order, getCurrentTimestamp());
+
+        if (order.orderId == -1) {
+          event.reply("Failed to place order.");
+          return;
+        }
 
         std::ostringstream oss;
         oss.imbue(std::locale(""));
-
-        oss << quantity;
+        oss << order.quantity;
 
         std::string quantityString = oss.str();
 
         oss.str("");
 
-        oss << std::fixed << std::setprecision(2) << value;
+        oss << std::fixed << std::setprecision((triggerPrice < 10.0) ? 4 : 2)
+            << triggerPrice;
 
-        std::string valueString = oss.str();
+        std::string priceString = oss.str();
 
-        oss.str("");
+        std::ostringstream replyStream;
+        replyStream << "Placed " << event.command.get_command_name()
+                    << " order **#" << order.orderId << "** to "
+                    << (order.side == OrderSide::Buy ? "buy" : "sell") << " **"
+                    << quantityString << " " << symbol << "** stock"
+                    << (order.quantity > 1 ? "s" : "") << " at **$"
+                    << priceString << "**.";
+
+        // The order only rests in the book once its row is durable.
+        dbHandler.afterCommit([event, order, &orderBook,
+                               reply = replyStream.str(),
+                               traceId = currentTraceId()](bool committed) {
+          TraceContext context(traceId);
+          TRACE_SCOPE("reply");
+
+          if (!committed) {
+            event.reply("Failed to place order.");
+            return;
+          }
+
+          orderBook.addOrder(order);
+          event.reply(reply);
+        });
+      });
+    }
 
-        oss << std::fixed << std::setprecision((price < 10.0) ? 4 : 2) << price;
+    if (event.command.get_command_name() == "orders") {
+      dbExecutor.post([event, user, accountId](DatabaseHandler &dbHandler) {
+        std::vector<Order> orders = dbHandler.getUserOrders(accountId);
 
-        std::string priceString = oss.str();
+        if (orders.size() == 0) {
+          event.reply("No open orders to display.");
+          return;
+        }
 
-        replyStream << "\n> **" << count++ << ".** **"
-                    << (std::stod(values[2]) < 0.0 ? "Bought " : "Sold ")
-                    << values[0] << "**"
-                    << "\n>     Quantity: " << quantityString
-                    << "\n>     Price: $" << priceString << "\n>     Total: $"
-                    << valueString << " USD"
-                    << "\n>     Date: " << values[3];
-      }
+        std::ostringstream replyStream;
+        replyStream << "## <@" << user.id.str() << ">'s Open Orders:";
 
-      std::string reply = replyStream.str();
+        for (const auto &order : orders) {
+          std::ostringstream oss;
+          oss.imbue(std::locale(""));
 
-      event.reply(reply);
+          oss << order.quantity;
+
+          std::string quantityString = oss.str();
+
+          oss.str("");
+
+          oss << std::fixed
+              << std::setprecision((order.triggerPrice < 10.0) ? 4 : 2)
+              << order.triggerPrice;
+
+          std::string priceString = oss.str();
+
+          replyStream << "\n> **#" << order.orderId << "** "
+                      << (order.type == OrderType::Limit ? "Limit " : "Stop ")
+                      << (order.side == OrderSide::Buy ? "buy " : "sell ")
+                      << quantityString << " " << order.stockName << " at $"
+                      << priceString;
+        }
+
+        event.reply(replyStream.str());
+      });
+    }
+
+    if (event.command.get_command_name() == "cancel") {
+      int64_t orderId = std::get<int64_t>(event.get_parameter("order"));
+
+      dbExecutor.post([event, accountId, orderId, &orderBook = shard.orderBook](
+                          DatabaseHandler &dbHandler) {
+        bool ownsOrder = false;
+        for (const auto &order : dbHandler.getUserOrders(accountId)) {
+          if (order.orderId == orderId) {
+            ownsOrder = true;
+            break;
+          }
+        }
+
+        if (!ownsOrder || !dbHandler.deleteOrder(orderId)) {
+          event.reply("Invalid order.");
+          return;
+        }
+
+        dbHandler.afterCommit([event, orderId, &orderBook,
+                               traceId = currentTraceId()](bool committed) {
+          TraceContext context(traceId);
+          TRACE_SCOPE("reply");
+
+          if (!committed) {
+            event.reply("Failed to cancel order.");
+            return;
+          }
+
+          orderBook.removeOrder(orderId);
+          event.reply("Cancelled order **#" + std::to_string(orderId) + "**.");
+        });
+      });
     }
 
     if (event.command.get_command_name() == "help") {
       std::string reply = "## Commands"
                           "\n> `/stockinfo [ticker]` - Retrieve data for a "
                           "stock given the ticker"
+                          "\n> `/chart [ticker] [range]` - Display a price "
+                          "chart for a stock"
                           "\n> `/balance` - Display your current balance"
                           "\n> `/buy [ticker] [quantity]` - Purchase stocks of "
                           "the given ticker and quantity"
                           "\n> `/sell [ticker] [quantity]` - Sell stocks of "
                           "the given ticker and quantity"
-                          "\n> `/stocks` - Display your current stocks"
+                          "\n> `/trade [orders]` - Buy and sell several "
+                          "stocks at once, e.g. `buy AAPL 5, sell TSLA 2`"
+                          "\n> `/limit [side] [ticker] [quantity] [price]` - "
+                          "Place an order that fills at the given price or "
+                          "better"
+                          "\n> `/stop [side] [ticker] [quantity] [price]` - "
+                          "Place an order that fills once the price crosses "
+                          "the given price"
+                          "\n> `/orders` - Display your open orders"
+                          "\n> `/cancel [order]` - Cancel an open order"
+                          "\n> `/stocks` - Display your current stocks and "
+                          "their profit or loss"
                           "\n> `/history` - Display your past transactions"
                           "\n> `/help` - Display this help message";
 
@@ -355,57 +1662,185 @@ int main(int argc, char *argv[]) {
     }
   });
 
-  bot.on_ready([&bot](const dpp::ready_t &event) {
-    bot.set_presence(
-        dpp::presence(dpp::ps_online, dpp::at_game, "with stonks"));
+  bot.on_autocomplete([&bot,
+                       &symbolDirectory](const dpp::autocomplete_t &event) {
+    TraceInteraction trace("autocomplete");
+
+    for (const dpp::command_option &option : event.options) {
+      if (!option.focused ||
+          !std::holds_alternative<std::string>(option.value)) {
+        continue;
+      }
 
-    if (dpp::run_once<struct clear_bot_commands>()) {
-      bot.global_bulk_command_delete();
+      std::string prefix = std::get<std::string>(option.value);
+      std::transform(prefix.begin(), prefix.end(), prefix.begin(), ::toupper);
+
+      dpp::interaction_response response(dpp::ir_autocomplete_reply);
+
+      for (const std::string &symbol : symbolDirectory.complete(prefix)) {
+        response.add_autocomplete_choice(
+            dpp::command_option_choice(symbol, symbol));
+      }
+
+      bot.interaction_response_create(event.command.id, event.command.token,
+                                      response);
+      return;
     }
+  });
 
-    if (dpp::run_once<struct register_bot_commands>()) {
-      dpp::slashcommand stockinfocommand(
-          "stockinfo", "Retrieves data for a stock.", bot.me.id);
-      stockinfocommand.add_option(dpp::command_option(
-          dpp::co_string, "ticker", "The ticker for the stock", true));
+  bot.on_button_click([&storage](const dpp::button_click_t &event) {
+    TraceInteraction trace("button");
+    PageCursor cursor;
 
-      dpp::slashcommand balancecommand("balance", "Displays your balance.",
-                                       bot.me.id);
+    if (!decodePageCursor(event.custom_id, cursor)) {
+      return;
+    }
 
-      dpp::slashcommand buycommand("buy", "Purchase stocks.", bot.me.id);
-      buycommand
-          .add_option(dpp::command_option(dpp::co_string, "ticker",
-                                          "The ticker for the stock", true))
-          .add_option(dpp::command_option(dpp::co_integer, "quantity",
-                                          "The amount of stocks to buy", true));
+    dpp::user user = event.command.get_issuing_user();
+    DatabaseExecutor &dbExecutor =
+        *storage.getShardForGuild(event.command.guild_id).executor;
+    std::string accountId =
+        StorageRouter::getAccountId(event.command.guild_id, user.id);
+
+    if (cursor.ownerId != user.id.str()) {
+      event.reply(dpp::ir_channel_message_with_source,
+                  dpp::message("Use the command yourself to page through "
+                               "your own results.")
+                      .set_flags(dpp::m_ephemeral));
+      return;
+    }
 
-      dpp::slashcommand sellcommand("sell", "Sell your stocks.", bot.me.id);
-      sellcommand
-          .add_option(dpp::command_option(dpp::co_string, "ticker",
-                                          "The ticker for the stock", true))
-          .add_option(dpp::command_option(dpp::co_integer, "quantity",
-                                          "The amount of stocks to sell",
-                                          true));
+    if (cursor.view == "history") {
+      int64_t transactionId;
 
-      dpp::slashcommand getstockscommand("stocks", "Displays your stocks.",
-                                         bot.me.id);
+      try {
+        transactionId = std::stoll(cursor.key);
+      } catch (const std::exception &) {
+        return;
+      }
 
-      dpp::slashcommand historycommand(
-          "history", "Displays your past transactions.", bot.me.id);
+      bool older = cursor.direction == 'o';
 
-      dpp::slashcommand helpcommand("help", "Displays a list of commands.",
-                                    bot.me.id);
+      dbExecutor.post([event, cursor, accountId, transactionId,
+                       older](DatabaseHandler &dbHandler) {
+        event.reply(dpp::ir_update_message,
+                    buildHistoryPage(dbHandler, accountId, cursor.ownerId,
+                                     transactionId, older));
+      });
+    }
 
-      bot.global_command_create(stockinfocommand);
-      bot.global_command_create(balancecommand);
-      bot.global_command_create(buycommand);
-      bot.global_command_create(sellcommand);
-      bot.global_command_create(getstockscommand);
-      bot.global_command_create(historycommand);
-      bot.global_command_create(helpcommand);
+    if (cursor.view == "stocks") {
+      event.reply(dpp::ir_deferred_update_message, dpp::message(),
+                  [&dbExecutor, event, accountId,
+                   cursor](const dpp::confirmation_callback_t &callback) {
+                    if (!callback.is_error()) {
+                      editWithStocksPage(dbExecutor, event, accountId,
+                                         cursor.ownerId, cursor.key,
+                                         cursor.direction == 'f');
+                    }
+                  });
     }
   });
 
+  bot.on_ready([&bot, primaryCluster](const dpp::ready_t &event) {
+    bot.set_presence(
+        dpp::presence(dpp::ps_online, dpp::at_game, "with stonks"));
+
+    if (primaryCluster && dpp::run_once<struct register_bot_commands>()) {
+      syncSlashCommands(bot, buildSlashCommands(bot.me.id), commandHashPath);
+    }
+  });
+
+  // Each process writes its own trace file, on a schedule and whenever it
+  // receives SIGUSR1.
+  std::string tracePath = tracePathPrefix + std::to_string(clusterId) + ".json";
+  std::signal(SIGUSR1, requestTrace);
+
+  bot.start_timer(
+      [tracePath](const dpp::timer &timer) { writeChromeTrace(tracePath); },
+      traceExportSeconds);
+
+  bot.start_timer(
+      [&bot, tracePath](const dpp::timer &timer) {
+        if (traceRequested.exchange(false) && writeChromeTrace(tracePath)) {
+          bot.log(dpp::ll_info, "Wrote trace to " + tracePath + ".");
+        }
+      },
+      traceSignalPollSeconds);
+
+  bot.start_timer(
+      [&bot, &symbolDirectory, primaryCluster](const dpp::timer &timer) {
+        refreshSymbolDirectory(bot, symbolDirectory, primaryCluster);
+      },
+      symbolRefreshSeconds);
+
+  if (primaryCluster) {
+    for (size_t i = 0; i < storage.size(); i++) {
+      StorageShard *shard = &storage.getShard(i);
+      BackupJob *backupJob = backupJobs[i].get();
+
+      bot.start_timer(
+          [&bot, shard](const dpp::timer &timer) {
+            pollOrders(bot, *shard->executor, shard->orderBook);
+          },
+          orderPollSeconds);
+
+      bot.start_timer(
+          [&bot, backupJob](const dpp::timer &timer) {
+            bool started = backupJob->start([&bot](const BackupResult &result) {
+              if (!result.success) {
+                bot.log(dpp::ll_error, "Database backup failed.");
+                return;
+              }
+
+              bot.log(dpp::ll_info,
+                      "Backed up database to " + result.path + " in " +
+                          std::to_string(result.durationMillis) + " ms over " +
+                          std::to_string(result.steps) + " steps and " +
+                          std::to_string(result.restarts) +
+                          " restarts; longest stall " +
+                          std::to_string(result.maxStallMicros) + " us.");
+            });
+
+            if (!started) {
+              bot.log(dpp::ll_warning,
+                      "Previous database backup still running.");
+            }
+          },
+          backupSeconds);
+
+      if (archiveAttached[i]) {
+        bot.start_timer(
+            [&bot, shard](const dpp::timer &timer) {
+              archiveLedger(bot, *shard->executor);
+            },
+            ledgerArchiveSeconds);
+      }
+    }
+
+    bot.start_timer(
+        [&bot, &tickStore](const dpp::timer &timer) {
+          maintainTickStore(bot, tickStore);
+        },
+        tickMaintenanceSeconds);
+
+    bot.start_timer(
+        [&bot, &quoteCache](const dpp::timer &timer) {
+          UpstreamStats stats = getUpstreamStats();
+
+          bot.log(dpp::ll_info,
+                  "Upstream quote fetches on this host: " +
+                      std::to_string(quoteCache.getUpstreamFetches()) +
+                      "; in this process " + std::to_string(stats.requests) +
+                      " with " + std::to_string(stats.retries) +
+                      " retries, " + std::to_string(stats.hedges) +
+                      " hedges (" + std::to_string(stats.hedgeWins) +
+                      " won) and " + std::to_string(stats.rejected) +
+                      " rejected by the circuit breaker.");
+        },
+        quoteStatsSeconds);
+  }
+
   bot.start(dpp::st_wait);
 
   return 0;
@@ -0,0 +1,128 @@
+#include "../include/orderBook.hpp"
+#include <algorithm>
+
+bool OrderBook::triggersOnFall(const Order &order) {
+  return (order.side == OrderSide::Buy && order.type == OrderType::Limit) ||
+         (order.side == OrderSide::Sell && order.type == OrderType::Stop);
+}
+
+void OrderBook::addOrder(const Order &order) {
+  std::lock_guard<std::mutex> lock(bookMutex);
+
+  if (locations.count(order.orderId)) {
+    return;
+  }
+
+  SymbolBook &book = books[order.stockName];
+  OrderLocation location;
+  location.stockName = order.stockName;
+  location.falling = triggersOnFall(order);
+
+  if (location.falling) {
+    location.fallingIt = book.falling.emplace(order.triggerPrice, order);
+  } else {
+    location.risingIt = book.rising.emplace(order.triggerPrice, order);
+  }
+
+  locations[order.orderId] = location;
+}
+
+void OrderBook::addPolledOrders(const std::vector<Order> &orders) {
+  int64_t highestOrderId = 0;
+
+  for (const Order &order : orders) {
+    addOrder(order);
+    highestOrderId = std::max(highestOrderId, order.orderId);
+  }
+
+  std::lock_guard<std::mutex> lock(bookMutex);
+  polledOrderId = std::max(polledOrderId, highestOrderId);
+}
+
+bool OrderBook::removeOrder(int64_t orderId) {
+  std::lock_guard<std::mutex> lock(bookMutex);
+
+  auto locationIt = locations.find(orderId);
+
+  if (locationIt == locations.end()) {
+    return false;
+  }
+
+  const OrderLocation &location = locationIt->second;
+  auto bookIt = books.find(location.stockName);
+
+  if (location.falling) {
+    bookIt->second.falling.erase(location.fallingIt);
+  } else {
+    bookIt->second.rising.erase(location.risingIt);
+  }
+
+  if (bookIt->second.falling.empty() && bookIt->second.rising.empty()) {
+    books.erase(bookIt);
+  }
+
+  locations.erase(locationIt);
+
+  return true;
+}
+
+std::vector<Order> OrderBook::onPrice(const std::string &stockName,
+                                      double price) {
+  std::lock_guard<std::mutex> lock(bookMutex);
+
+  std::vector<Order> triggered;
+
+  auto bookIt = books.find(stockName);
+
+  if (bookIt == books.end()) {
+    return triggered;
+  }
+
+  FallingBook &falling = bookIt->second.falling;
+  RisingBook &rising = bookIt->second.rising;
+
+  auto fallingIt = falling.begin();
+  while (fallingIt != falling.end() && fallingIt->first >= price) {
+    locations.erase(fallingIt->second.orderId);
+    triggered.push_back(std::move(fallingIt->second));
+    fallingIt = falling.erase(fallingIt);
+  }
+
+  auto risingIt = rising.begin();
+  while (risingIt != rising.end() && risingIt->first <= price) {
+    locations.erase(risingIt->second.orderId);
+    triggered.push_back(std::move(risingIt->second));
+    risingIt = rising.erase(risingIt);
+  }
+
+  if (falling.empty() && rising.empty()) {
+    books.erase(bookIt);
+  }
+
+  return triggered;
+}
+
+std::vector<std::string> OrderBook::getSymbols() {
+  std::lock_guard<std::mutex> lock(bookMutex);
+
+  std::vector<std::string> symbols;
+  symbols.reserve(books.size());
+
+  for (const auto &book : books) {
+    symbols.push_back(book.first);
+  }
+
+  return symbols;
+}
+
+int64_t OrderBook::getPolledOrderId() {
+  std::lock_guard<std::mutex> lock(bookMutex);
+
+  return polledOrderId;
+}
+
+size_t OrderBook::size() {
+  std::lock_guard<std::mutex> lock(bookMutex);
+
+  return locations.size();
+}
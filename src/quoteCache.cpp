@@ -0,0 +1,342 @@
+#include "../include/quoteCache.hpp"
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+
+const uint32_t tableVersion = 2;
+// Yields a reader spends waiting on a writer before treating the entry as
+// uncached.
+const int writerWaitSpins = 1000;
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free &&
+                  std::atomic<int64_t>::is_always_lock_free &&
+                  std::atomic<uint64_t>::is_always_lock_free,
+              "Shared memory atomics must be lock-free");
+
+int64_t nowMillis() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+size_t hashSymbol(const std::string &symbol) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+
+  for (unsigned char byte : symbol) {
+    hash ^= byte;
+    hash *= 0x100000001b3ULL;
+  }
+
+  return static_cast<size_t>(hash % QUOTE_CACHE_SLOTS);
+}
+
+} // namespace
+
+QuoteCache::QuoteCache(const std::string &name) : name(name) {
+  int fd = shm_open(name.c_str(), O_RDWR | O_CREAT, 0600);
+
+  if (fd < 0) {
+    std::cerr << "Failed to open shared quote cache." << std::endl;
+    return;
+  }
+
+  if (ftruncate(fd, sizeof(Table)) != 0) {
+    std::cerr << "Failed to size shared quote cache." << std::endl;
+    close(fd);
+    return;
+  }
+
+  void *mapped =
+      mmap(nullptr, sizeof(Table), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (mapped == MAP_FAILED) {
+    std::cerr << "Failed to map shared quote cache." << std::endl;
+    return;
+  }
+
+  table = static_cast<Table *>(mapped);
+
+  // A freshly created table is all zeroes, which is a valid empty table.
+  uint32_t version = 0;
+  if (!table->version.compare_exchange_strong(version, tableVersion) &&
+      version != tableVersion) {
+    std::cerr << "Shared quote cache " << name
+              << " has an incompatible layout." << std::endl;
+    munmap(table, sizeof(Table));
+    table = nullptr;
+  }
+}
+
+QuoteCache::~QuoteCache() {
+  if (table) {
+    munmap(table, sizeof(Table));
+  }
+}
+
+bool QuoteCache::isOpen() const { return table != nullptr; }
+
+// Waits for the writer holding the entry, if any, and returns its even
+// sequence. Gives up after a bounded wait, unless the writer has held the
+// entry for QUOTE_STUCK_MILLIS: it died mid-write, so the entry may be torn
+// and is cleared and released instead.
+bool QuoteCache::waitForWriter(Entry &entry, uint32_t &sequence) {
+  for (int spins = 0; spins < writerWaitSpins; spins++) {
+    sequence = entry.sequence.load(std::memory_order_acquire);
+
+    if (!(sequence & 1)) {
+      return true;
+    }
+
+    if (nowMillis() - entry.lockedAt.load() >= QUOTE_STUCK_MILLIS) {
+      entry.lockedAt.store(nowMillis());
+
+      if (entry.sequence.compare_exchange_strong(sequence, sequence + 2,
+                                                 std::memory_order_acquire)) {
+        entry.fetchedAt = 0;
+        entry.sequence.store(sequence + 3, std::memory_order_release);
+      }
+
+      continue;
+    }
+
+    std::this_thread::yield();
+  }
+
+  return false;
+}
+
+// Takes the entry's seqlock and returns the sequence it had; the writer
+// releases it by storing that sequence plus two.
+uint32_t QuoteCache::lockEntry(Entry &entry) {
+  while (true) {
+    uint32_t sequence;
+
+    if (!waitForWriter(entry, sequence)) {
+      continue;
+    }
+
+    // Stamped before taking the lock, so it can only ever look fresher than
+    // it is and never gets a live writer reset.
+    entry.lockedAt.store(nowMillis());
+
+    if (entry.sequence.compare_exchange_weak(sequence, sequence + 1,
+                                             std::memory_order_acquire)) {
+      return sequence;
+    }
+  }
+}
+
+QuoteCache::Entry *QuoteCache::findEntry(const std::string &symbol,
+                                         bool create) {
+  if (symbol.empty() || symbol.size() >= QUOTE_SYMBOL_LENGTH) {
+    return nullptr;
+  }
+
+  size_t index = hashSymbol(symbol);
+  int64_t now = nowMillis();
+  Entry *evictable = nullptr;
+  std::string evictableSymbol;
+
+  for (size_t probes = 0; probes < QUOTE_CACHE_SLOTS;) {
+    Entry &entry = table->entries[index];
+    uint32_t sequence;
+
+    // A slot whose writer does not let go cannot be probed past.
+    if (!waitForWriter(entry, sequence)) {
+      return nullptr;
+    }
+
+    char slotSymbol[QUOTE_SYMBOL_LENGTH];
+    std::memcpy(slotSymbol, entry.symbol, QUOTE_SYMBOL_LENGTH);
+    int64_t fetchedAt = entry.fetchedAt;
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    if (entry.sequence.load(std::memory_order_relaxed) != sequence) {
+      continue;
+    }
+
+    slotSymbol[QUOTE_SYMBOL_LENGTH - 1] = '\0';
+
+    if (symbol == slotSymbol) {
+      return &entry;
+    }
+
+    if (slotSymbol[0] == '\0') {
+      if (!create) {
+        return nullptr;
+      }
+
+      // The symbol is not in the table; prefer reusing an expired slot on
+      // its probe chain over lengthening the chain.
+      if (evictable && takeOverEntry(*evictable, evictableSymbol, symbol)) {
+        return evictable;
+      }
+
+      evictable = nullptr;
+
+      // Claim the empty slot; if another writer got there first, look at
+      // the same slot again.
+      entry.lockedAt.store(nowMillis());
+
+      if (entry.sequence.compare_exchange_strong(sequence, sequence + 1,
+                                                 std::memory_order_acquire)) {
+        if (entry.symbol[0] == '\0') {
+          std::strncpy(entry.symbol, symbol.c_str(), QUOTE_SYMBOL_LENGTH - 1);
+          entry.fetchedAt = 0;
+        }
+
+        bool claimed = symbol == entry.symbol;
+        entry.sequence.store(sequence + 2, std::memory_order_release);
+
+        if (claimed) {
+          return &entry;
+        }
+      }
+
+      continue;
+    }
+
+    if (!evictable && now - fetchedAt >= QUOTE_EVICT_MILLIS &&
+        now - entry.claimedAt.load() >= QUOTE_CLAIM_MILLIS) {
+      evictable = &entry;
+      evictableSymbol = slotSymbol;
+    }
+
+    index = (index + 1) % QUOTE_CACHE_SLOTS;
+    probes++;
+  }
+
+  // The table is full.
+  if (create && evictable &&
+      takeOverEntry(*evictable, evictableSymbol, symbol)) {
+    return evictable;
+  }
+
+  return nullptr;
+}
+
+// Hands an expired slot over to `symbol`, unless it changed since it was
+// found. Slots are never emptied again, so other symbols' probe chains
+// through them stay intact.
+bool QuoteCache::takeOverEntry(Entry &entry, const std::string &evicted,
+                               const std::string &symbol) {
+  uint32_t sequence = lockEntry(entry);
+  int64_t now = nowMillis();
+
+  bool expired =
+      std::strncmp(entry.symbol, evicted.c_str(), QUOTE_SYMBOL_LENGTH) == 0 &&
+      now - entry.fetchedAt >= QUOTE_EVICT_MILLIS &&
+      now - entry.claimedAt.load() >= QUOTE_CLAIM_MILLIS;
+
+  if (expired) {
+    std::strncpy(entry.symbol, symbol.c_str(), QUOTE_SYMBOL_LENGTH - 1);
+    entry.fetchedAt = 0;
+  }
+
+  entry.sequence.store(sequence + 2, std::memory_order_release);
+  return expired;
+}
+
+bool QuoteCache::readEntry(Entry &entry, const std::string &symbol,
+                           Quote &quote, int64_t &fetchedAt) {
+  while (true) {
+    uint32_t sequence;
+
+    if (!waitForWriter(entry, sequence)) {
+      return false;
+    }
+
+    char slotSymbol[QUOTE_SYMBOL_LENGTH];
+    std::memcpy(slotSymbol, entry.symbol, QUOTE_SYMBOL_LENGTH);
+    std::memcpy(&quote, &entry.quote, sizeof(Quote));
+    fetchedAt = entry.fetchedAt;
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    if (entry.sequence.load(std::memory_order_relaxed) == sequence) {
+      slotSymbol[QUOTE_SYMBOL_LENGTH - 1] = '\0';
+      return symbol == slotSymbol && fetchedAt > 0;
+    }
+  }
+}
+
+bool QuoteCache::getQuote(const std::string &symbol, Quote &quote,
+                          const std::function<bool(Quote &)> &fetch) {
+  Entry *entry = table ? findEntry(symbol, true) : nullptr;
+
+  if (!entry) {
+    if (table) {
+      table->upstreamFetches++;
+    }
+
+    return fetch(quote);
+  }
+
+  int64_t start = nowMillis();
+  int64_t fetchedAt;
+
+  if (readEntry(*entry, symbol, quote, fetchedAt) &&
+      start - fetchedAt < QUOTE_TTL_MILLIS) {
+    return true;
+  }
+
+  int64_t claimedAt = entry->claimedAt.load();
+
+  if (start - claimedAt >= QUOTE_CLAIM_MILLIS &&
+      entry->claimedAt.compare_exchange_strong(claimedAt, start)) {
+    table->upstreamFetches++;
+
+    bool success = fetch(quote);
+
+    if (success) {
+      uint32_t sequence = lockEntry(*entry);
+
+      // A slot that never got a quote can be handed to another symbol
+      // while this one is being fetched; the quote is then not cached.
+      if (std::strncmp(entry->symbol, symbol.c_str(), QUOTE_SYMBOL_LENGTH) ==
+          0) {
+        std::memcpy(&entry->quote, &quote, sizeof(Quote));
+        entry->fetchedAt = nowMillis();
+      }
+
+      entry->sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    // Only release the claim if it is still ours; if the fetch overran it,
+    // another process may have claimed the entry since.
+    int64_t claim = start;
+    entry->claimedAt.compare_exchange_strong(claim, 0);
+    return success;
+  }
+
+  // Another process is fetching this symbol; wait for its result.
+  while (nowMillis() - start < QUOTE_CLAIM_MILLIS) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    if (readEntry(*entry, symbol, quote, fetchedAt) && fetchedAt >= start) {
+      return true;
+    }
+
+    if (entry->claimedAt.load() == 0) {
+      break;
+    }
+  }
+
+  if (readEntry(*entry, symbol, quote, fetchedAt) &&
+      nowMillis() - fetchedAt < QUOTE_TTL_MILLIS) {
+    return true;
+  }
+
+  table->upstreamFetches++;
+  return fetch(quote);
+}
+
+uint64_t QuoteCache::getUpstreamFetches() const {
+  return table ? table->upstreamFetches.load() : 0;
+}
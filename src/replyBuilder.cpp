@@ -0,0 +1,70 @@
+#include "../include/replyBuilder.hpp"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+ReplyArena::ReplyArena() : resource(buffer, sizeof(buffer)) {}
+
+std::pmr::memory_resource *ReplyArena::get() { return &resource; }
+
+namespace {
+
+// Appends the digits in [digits, digits + length) with a comma before every
+// group of three counted from the right.
+void appendGrouped(std::pmr::string &out, const char *digits, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    if (i > 0 && (length - i) % 3 == 0) {
+      out += ',';
+    }
+
+    out += digits[i];
+  }
+}
+
+} // namespace
+
+void appendInteger(std::pmr::string &out, int64_t value) {
+  char digits[24];
+  int length = std::snprintf(digits, sizeof(digits), "%lld",
+                             static_cast<long long>(value));
+
+  if (digits[0] == '-') {
+    out += '-';
+    appendGrouped(out, digits + 1, length - 1);
+  } else {
+    appendGrouped(out, digits, length);
+  }
+}
+
+void appendFixed(std::pmr::string &out, double value, int precision) {
+  char digits[64];
+  int length = std::snprintf(digits, sizeof(digits), "%.*f", precision,
+                             std::fabs(value));
+
+  // Values too large to print here are not meaningful prices.
+  if (length < 0 || static_cast<size_t>(length) >= sizeof(digits)) {
+    out += "?";
+    return;
+  }
+
+  bool zero = std::strspn(digits, "0.") == static_cast<size_t>(length);
+
+  if (std::signbit(value) && !zero) {
+    out += '-';
+  }
+
+  const char *point = std::strchr(digits, '.');
+  size_t integerLength = point ? point - digits : length;
+
+  appendGrouped(out, digits, integerLength);
+  out.append(digits + integerLength, length - integerLength);
+}
+
+void appendMoney(std::pmr::string &out, double value) {
+  appendFixed(out, value, 2);
+}
+
+void appendSignedMoney(std::pmr::string &out, double value) {
+  out += value < 0.0 ? "-$" : "+$";
+  appendFixed(out, std::fabs(value), 2);
+}
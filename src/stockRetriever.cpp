@@ -1,16 +1,65 @@
+#include <chrono>
 #include <curl/curl.h>
 #include <curl/easy.h>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <jsoncpp/json/json.h>
 #include <jsoncpp/json/reader.h>
 #include <jsoncpp/json/value.h>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../include/stockRetriever.h"
+#include "../include/tracer.hpp"
+#include "../include/upstreamClient.hpp"
 
 const std::string configPath = "../data/config.json";
+const std::string defaultBaseUrl = "https://finnhub.io/api/v1";
+// The symbol list is several megabytes, so it gets a longer timeout and no
+// hedging.
+const long symbolListTimeoutMillis = 60 * 1000;
+
+std::function<void(const std::string &, double)> priceListener;
+QuoteCache *quoteCache = nullptr;
+SymbolDirectory *symbolDirectory = nullptr;
+UpstreamClient upstreamClient;
+
+struct LastQuote {
+  Quote quote;
+  int64_t seenAt;
+};
+
+// Last live quote seen for each symbol, shown by display commands while the
+// upstream is failing. Trades never see it.
+std::mutex lastQuotesMutex;
+std::unordered_map<std::string, LastQuote> lastQuotes;
+
+int64_t steadyMillis() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void setQuoteCache(QuoteCache *cache) { quoteCache = cache; }
+
+void setSymbolDirectory(SymbolDirectory *directory) {
+  symbolDirectory = directory;
+}
+
+void setPriceListener(
+    std::function<void(const std::string &, double)> listener) {
+  priceListener = std::move(listener);
+}
+
+// Builds a Finnhub URL from a path and query. "finnhub_base_url" in the
+// config overrides the host, e.g. to point at a local test server.
+std::string getApiUrl(const std::string &pathAndQuery) {
+  TRACE_SCOPE("config.read");
 
-std::string getApiKey() {
   std::ifstream file(configPath, std::ifstream::in);
 
   if (!file.is_open()) {
@@ -22,9 +71,10 @@ std::string getApiKey() {
   Json::CharReaderBuilder reader;
   Json::parseFromStream(reader, file, &root, nullptr);
 
+  std::string baseUrl = root.get("finnhub_base_url", defaultBaseUrl).asString();
   std::string apiKey = root["finnhub_api_key"].asString();
 
-  return apiKey;
+  return baseUrl + pathAndQuery + "&token=" + apiKey;
 }
 
 size_t writeCallback(void *contents, size_t size, size_t nmemb,
@@ -34,23 +84,29 @@ size_t writeCallback(void *contents, size_t size, size_t nmemb,
   return totalSize;
 }
 
-std::string retrieveJsonData(const std::string &symbol) {
+std::string retrieveUrl(const std::string &url) {
   CURL *curl = curl_easy_init();
-  std::string url = "https://finnhub.io/api/v1/quote?symbol=" + symbol +
-                    "&token=" + getApiKey();
 
   if (curl) {
     CURLcode res;
     std::string response;
+    long status = 0;
 
     curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeCallback);
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS,
+                     static_cast<long>(UPSTREAM_CONNECT_TIMEOUT_MILLIS));
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, symbolListTimeoutMillis);
 
     res = curl_easy_perform(curl);
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
 
-    if (res != CURLE_OK) {
-      std::cerr << "Failed to retrieve data: " << curl_easy_strerror(res)
+    if (res != CURLE_OK || status != 200) {
+      std::cerr << "Failed to retrieve data: "
+                << (res != CURLE_OK ? curl_easy_strerror(res)
+                                    : "HTTP " + std::to_string(status))
                 << std::endl;
       curl_easy_cleanup(curl);
       return "";
@@ -63,76 +119,175 @@ std::string retrieveJsonData(const std::string &symbol) {
   return "";
 }
 
-double parseStockPrice(const std::string &jsonData) {
-  Json::CharReaderBuilder reader;
-  Json::Value root;
-  std::istringstream jsonStream(jsonData);
-  Json::parseFromStream(reader, jsonStream, &root, nullptr);
-
-  double price = root["c"].asDouble();
+std::string retrieveJsonData(const std::string &symbol) {
+  std::string response;
 
-  if (price == 0) {
-    std::cerr << "Unable to retrieve price value." << std::endl;
-    return -1.0;
+  if (!upstreamClient.get(getApiUrl("/quote?symbol=" + symbol), response)) {
+    return "";
   }
 
-  return price;
+  return response;
 }
 
-double parseChange(const std::string &jsonData) {
+bool parseQuote(const std::string &jsonData, Quote &quote) {
+  TRACE_SCOPE("json.parse");
+
   Json::CharReaderBuilder reader;
   Json::Value root;
   std::istringstream jsonStream(jsonData);
-  Json::parseFromStream(reader, jsonStream, &root, nullptr);
+
+  if (!Json::parseFromStream(reader, jsonStream, &root, nullptr)) {
+    std::cerr << "Failed to parse quote data." << std::endl;
+    return false;
+  }
+
+  quote.price = root["c"].asDouble();
+
+  if (quote.price == 0) {
+    std::cerr << "Unable to retrieve price value." << std::endl;
+    quote.price = -1.0;
+  }
 
   if (root["d"].isNull()) {
     std::cerr << "Change value is null." << std::endl;
-    return -1.0;
+    quote.change = -1.0;
+  } else {
+    quote.change = root["d"].asDouble();
+  }
+
+  if (root["dp"].isNull()) {
+    std::cerr << "Percent change value is null." << std::endl;
+    quote.percentChange = -1.0;
+  } else {
+    quote.percentChange = root["dp"].asDouble();
   }
 
-  return root["d"].asDouble();
+  return true;
 }
 
-double parsePercentChange(const std::string &jsonData) {
-  Json::CharReaderBuilder reader;
-  Json::Value root;
-  std::istringstream jsonStream(jsonData);
-  Json::parseFromStream(reader, jsonStream, &root, nullptr);
+bool fetchQuote(const std::string &symbol, Quote &quote) {
+  std::string jsonData = retrieveJsonData(symbol);
 
-  if (root["dp"].isNull()) {
-    std::cerr << "Percent change value is null." << std::endl;
-    return -1.0;
+  if (jsonData.empty() || !parseQuote(jsonData, quote)) {
+    return false;
   }
 
-  return root["dp"].asDouble();
+  if (quote.price != -1.0 && priceListener) {
+    priceListener(symbol, quote.price);
+  }
+
+  return true;
+}
+
+bool getLiveQuote(const std::string &symbol, Quote &quote) {
+  if (quoteCache && quoteCache->isOpen()) {
+    // Unknown tickers come back with a price of -1 and are left out of the
+    // table, so their slots can be reused.
+    return quoteCache->getQuote(symbol, quote, [&symbol](Quote &fetched) {
+      return fetchQuote(symbol, fetched) && fetched.price != -1.0;
+    });
+  }
+
+  return fetchQuote(symbol, quote);
+}
+
+bool getQuote(const std::string &symbol, Quote &quote, bool *stale) {
+  TRACE_SCOPE("quote");
+
+  if (symbolDirectory && symbolDirectory->isLoaded() &&
+      !symbolDirectory->contains(symbol)) {
+    return false;
+  }
+
+  if (stale) {
+    *stale = false;
+  }
+
+  if (getLiveQuote(symbol, quote)) {
+    if (quote.price != -1.0) {
+      std::lock_guard<std::mutex> lock(lastQuotesMutex);
+      lastQuotes[symbol] = {quote, steadyMillis()};
+    }
+
+    return true;
+  }
+
+  if (!stale) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(lastQuotesMutex);
+  auto it = lastQuotes.find(symbol);
+
+  if (it == lastQuotes.end() ||
+      steadyMillis() - it->second.seenAt > STALE_QUOTE_MAX_MILLIS) {
+    return false;
+  }
+
+  quote = it->second.quote;
+  *stale = true;
+
+  return true;
 }
 
 double getStockPrice(const std::string &symbol) {
-  std::string jsonData = retrieveJsonData(symbol);
+  Quote quote;
 
-  if (!jsonData.empty()) {
-    return parseStockPrice(jsonData);
-  } else {
+  if (!getQuote(symbol, quote)) {
     return -1.0;
   }
+
+  return quote.price;
 }
 
 double getChange(const std::string &symbol) {
-  std::string jsonData = retrieveJsonData(symbol);
+  Quote quote;
 
-  if (!jsonData.empty()) {
-    return parseChange(jsonData);
-  } else {
+  if (!getQuote(symbol, quote)) {
     return -1.0;
   }
+
+  return quote.change;
 }
 
 double getPercentChange(const std::string &symbol) {
-  std::string jsonData = retrieveJsonData(symbol);
+  Quote quote;
 
-  if (!jsonData.empty()) {
-    return parsePercentChange(jsonData);
-  } else {
+  if (!getQuote(symbol, quote)) {
     return -1.0;
   }
+
+  return quote.percentChange;
+}
+
+bool getExchangeSymbols(const std::string &exchange,
+                        std::vector<std::string> &symbols) {
+  std::string jsonData =
+      retrieveUrl(getApiUrl("/stock/symbol?exchange=" + exchange));
+
+  Json::CharReaderBuilder reader;
+  Json::Value root;
+  std::istringstream jsonStream(jsonData);
+
+  if (jsonData.empty() ||
+      !Json::parseFromStream(reader, jsonStream, &root, nullptr) ||
+      !root.isArray()) {
+    std::cerr << "Failed to parse symbol list." << std::endl;
+    return false;
+  }
+
+  symbols.clear();
+  symbols.reserve(root.size());
+
+  for (const Json::Value &entry : root) {
+    std::string symbol = entry["symbol"].asString();
+
+    if (!symbol.empty()) {
+      symbols.push_back(symbol);
+    }
+  }
+
+  return !symbols.empty();
 }
+
+UpstreamStats getUpstreamStats() { return upstreamClient.getStats(); }
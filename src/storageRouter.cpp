@@ -0,0 +1,691 @@
+#include "../include/storageRouter.hpp"
+#include <algorithm>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/file.h>
+#include <unistd.h>
+#include <utility>
+
+namespace {
+
+// Bounds of every account key in a guild: "<guild>:" up to "<guild>;".
+std::pair<std::string, std::string> guildKeyRange(uint64_t guildId) {
+  std::string prefix = std::to_string(guildId);
+
+  return std::make_pair(prefix + ":", prefix + ";");
+}
+
+// Runs each statement with the guild's key range bound to ?1 and ?2.
+bool runForGuild(sqlite3 *db, const std::vector<std::string> &queries,
+                 uint64_t guildId) {
+  std::pair<std::string, std::string> range = guildKeyRange(guildId);
+
+  for (const std::string &query : queries) {
+    sqlite3_stmt *stmt;
+
+    if (sqlite3_prepare_v2(db, query.c_str(), -1, &stmt, nullptr) !=
+        SQLITE_OK) {
+      std::cerr << "Failed to prepare statement: " << sqlite3_errmsg(db)
+                << std::endl;
+      return false;
+    }
+
+    sqlite3_bind_text(stmt, 1, range.first.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, range.second.c_str(), -1, SQLITE_STATIC);
+
+    int result = sqlite3_step(stmt);
+
+    sqlite3_finalize(stmt);
+
+    if (result != SQLITE_DONE && result != SQLITE_ROW) {
+      std::cerr << "Failed to move guild rows: " << sqlite3_errmsg(db)
+                << std::endl;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool attachDatabase(sqlite3 *db, const std::string &path, const char *name) {
+  std::string query = std::string("ATTACH DATABASE ? AS ") + name;
+  sqlite3_stmt *stmt;
+
+  if (sqlite3_prepare_v2(db, query.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+    return false;
+  }
+
+  sqlite3_bind_text(stmt, 1, path.c_str(), -1, SQLITE_STATIC);
+
+  int result = sqlite3_step(stmt);
+
+  sqlite3_finalize(stmt);
+
+  return result == SQLITE_DONE;
+}
+
+uint64_t mixGuildId(uint64_t guildId) {
+  // splitmix64 finalizer; the low bits of a snowflake are a per-process
+  // counter.
+  guildId ^= guildId >> 30;
+  guildId *= 0xbf58476d1ce4e5b9ULL;
+  guildId ^= guildId >> 27;
+  guildId *= 0x94d049bb133111ebULL;
+  guildId ^= guildId >> 31;
+
+  return guildId;
+}
+
+} // namespace
+
+// flock, not fcntl: closing any descriptor for a file drops every fcntl lock
+// the process holds on it, including SQLite's, so the lock lives in a file of
+// its own.
+ShardLock::ShardLock(const std::string &dbPath, bool exclusive) {
+  std::string lockPath = dbPath + "-lock";
+  fd = open(lockPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+
+  if (fd < 0) {
+    std::cerr << "Failed to open " << lockPath << "." << std::endl;
+    return;
+  }
+
+  if (flock(fd, (exclusive ? LOCK_EX : LOCK_SH) | LOCK_NB) != 0) {
+    close(fd);
+    fd = -1;
+  }
+}
+
+ShardLock::~ShardLock() {
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+bool ShardLock::isHeld() const { return fd >= 0; }
+
+StorageRouter::StorageRouter(const std::string &catalogPath,
+                             const std::string &dbPath,
+                             const std::string &archivePath,
+                             size_t shardCount) {
+  for (size_t i = 0; i < std::max<size_t>(shardCount, 1); i++) {
+    auto shard = std::make_unique<StorageShard>();
+    shard->index = i;
+    shard->dbPath = getShardPath(dbPath, i);
+    shard->archivePath = getShardPath(archivePath, i);
+    shard->executor = std::make_unique<DatabaseExecutor>(shard->dbPath);
+    shards.push_back(std::move(shard));
+  }
+
+  if (sqlite3_open(catalogPath.c_str(), &catalog) != SQLITE_OK) {
+    std::cerr << "Failed to open shard catalog: " << catalogPath << std::endl;
+    sqlite3_close(catalog);
+    catalog = nullptr;
+    return;
+  }
+
+  sqlite3_busy_timeout(catalog, 5000);
+
+  const char *createCatalogQuery =
+      "PRAGMA journal_mode=WAL;"
+      "CREATE TABLE IF NOT EXISTS guild_shards ("
+      "guild_id INTEGER PRIMARY KEY,"
+      "shard INTEGER NOT NULL"
+      ");"
+      "CREATE TABLE IF NOT EXISTS legacy_accounts ("
+      "guild_id INTEGER NOT NULL"
+      ");";
+
+  if (sqlite3_exec(catalog, createCatalogQuery, nullptr, nullptr, nullptr) !=
+      SQLITE_OK) {
+    std::cerr << "Failed to create shard catalog." << std::endl;
+    sqlite3_close(catalog);
+    catalog = nullptr;
+    return;
+  }
+
+  const char *query = "SELECT guild_id, shard FROM guild_shards";
+  sqlite3_stmt *stmt;
+
+  if (sqlite3_prepare_v2(catalog, query, -1, &stmt, nullptr) != SQLITE_OK) {
+    std::cerr << "Failed to prepare statement for reading shard catalog."
+              << std::endl;
+    sqlite3_close(catalog);
+    catalog = nullptr;
+    return;
+  }
+
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    placements[static_cast<uint64_t>(sqlite3_column_int64(stmt, 0))] =
+        static_cast<size_t>(sqlite3_column_int64(stmt, 1));
+  }
+
+  sqlite3_finalize(stmt);
+
+  for (const auto &placement : placements) {
+    if (placement.second >= shards.size()) {
+      std::cerr << "Shard catalog places guild " << placement.first
+                << " on shard " << placement.second << ", but only "
+                << shards.size() << " are configured." << std::endl;
+      sqlite3_close(catalog);
+      catalog = nullptr;
+      return;
+    }
+  }
+}
+
+StorageRouter::~StorageRouter() {
+  // Catalog writes may still be queued on shard 0's executor.
+  for (auto &shard : shards) {
+    shard->executor.reset();
+  }
+
+  if (catalog) {
+    sqlite3_close(catalog);
+  }
+}
+
+bool StorageRouter::isOpen() const { return catalog != nullptr; }
+
+bool StorageRouter::lockShards(bool exclusive) {
+  locks.clear();
+
+  for (auto &shard : shards) {
+    locks.push_back(std::make_unique<ShardLock>(shard->dbPath, exclusive));
+
+    if (!locks.back()->isHeld()) {
+      std::cerr << shard->dbPath << " is locked by another process."
+                << std::endl;
+      locks.clear();
+      return false;
+    }
+  }
+
+  return true;
+}
+
+size_t StorageRouter::size() const { return shards.size(); }
+
+StorageShard &StorageRouter::getShard(size_t index) { return *shards[index]; }
+
+StorageShard &StorageRouter::getShardForGuild(uint64_t guildId) {
+  // Guilds are recorded even with one shard, so it can be split later.
+  if (guildId == 0) {
+    return *shards[0];
+  }
+
+  size_t index;
+
+  {
+    std::lock_guard<std::mutex> lock(placementsMutex);
+
+    auto it = placements.find(guildId);
+
+    if (it != placements.end()) {
+      return *shards[it->second];
+    }
+
+    index = mixGuildId(guildId) % shards.size();
+    placements[guildId] = index;
+  }
+
+  shards[0]->executor->post(
+      [this, guildId, index](DatabaseHandler & /*dbHandler*/) {
+        recordPlacement(guildId, index);
+      },
+      false);
+
+  return *shards[index];
+}
+
+void StorageRouter::recordPlacement(uint64_t guildId, size_t index) {
+  std::lock_guard<std::mutex> lock(catalogMutex);
+
+  // Another process may have placed the guild already; whichever insert
+  // lands first decides. Processes configured with the same shard count hash
+  // a guild to the same shard, so they can only disagree after db_shards was
+  // changed without restarting all of them.
+  const char *insertQuery =
+      "INSERT OR IGNORE INTO guild_shards (guild_id, shard) VALUES (?, ?)";
+  const char *selectQuery = "SELECT shard FROM guild_shards WHERE guild_id = ?";
+  size_t recorded = index;
+  sqlite3_stmt *stmt;
+
+  if (sqlite3_prepare_v2(catalog, insertQuery, -1, &stmt, nullptr) ==
+      SQLITE_OK) {
+    sqlite3_bind_int64(stmt, 1, static_cast<sqlite3_int64>(guildId));
+    sqlite3_bind_int64(stmt, 2, static_cast<sqlite3_int64>(index));
+    sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+  }
+
+  if (sqlite3_prepare_v2(catalog, selectQuery, -1, &stmt, nullptr) ==
+      SQLITE_OK) {
+    sqlite3_bind_int64(stmt, 1, static_cast<sqlite3_int64>(guildId));
+
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+      recorded = static_cast<size_t>(sqlite3_column_int64(stmt, 0)) %
+                 shards.size();
+    }
+
+    sqlite3_finalize(stmt);
+  } else {
+    std::cerr << "Failed to prepare statement for placing guild." << std::endl;
+  }
+
+  if (recorded != index) {
+    std::cerr << "Guild " << guildId << " was placed on shard " << recorded
+              << " by another process, not " << index << "." << std::endl;
+
+    std::lock_guard<std::mutex> placementsLock(placementsMutex);
+    placements[guildId] = recorded;
+  }
+}
+
+std::vector<uint64_t> StorageRouter::getGuilds(size_t index) {
+  std::lock_guard<std::mutex> lock(placementsMutex);
+  std::vector<uint64_t> guilds;
+
+  for (const auto &placement : placements) {
+    if (placement.second == index) {
+      guilds.push_back(placement.first);
+    }
+  }
+
+  std::sort(guilds.begin(), guilds.end());
+
+  return guilds;
+}
+
+bool StorageRouter::setPlacement(uint64_t guildId, size_t index) {
+  std::lock_guard<std::mutex> lock(catalogMutex);
+
+  const char *query =
+      "INSERT OR REPLACE INTO guild_shards (guild_id, shard) VALUES (?, ?)";
+  sqlite3_stmt *stmt;
+
+  if (sqlite3_prepare_v2(catalog, query, -1, &stmt, nullptr) != SQLITE_OK) {
+    std::cerr << "Failed to prepare statement for placing guild." << std::endl;
+    return false;
+  }
+
+  sqlite3_bind_int64(stmt, 1, static_cast<sqlite3_int64>(guildId));
+  sqlite3_bind_int64(stmt, 2, static_cast<sqlite3_int64>(index));
+
+  int result = sqlite3_step(stmt);
+
+  sqlite3_finalize(stmt);
+
+  if (result != SQLITE_DONE) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> placementsLock(placementsMutex);
+  placements[guildId] = index;
+  return true;
+}
+
+int64_t StorageRouter::getGuildActivity(StorageShard &shard,
+                                        uint64_t guildId) {
+  return shard.executor
+      ->submit([guildId](DatabaseHandler &dbHandler) {
+        std::pair<std::string, std::string> range = guildKeyRange(guildId);
+        int64_t count = 0;
+
+        const char *query = "SELECT COUNT(*) FROM user_transactions WHERE "
+                            "user_id >= ? AND user_id < ?";
+        sqlite3_stmt *stmt;
+
+        if (sqlite3_prepare_v2(dbHandler.getConnection(), query, -1, &stmt,
+                               nullptr) == SQLITE_OK) {
+          sqlite3_bind_text(stmt, 1, range.first.c_str(), -1, SQLITE_STATIC);
+          sqlite3_bind_text(stmt, 2, range.second.c_str(), -1, SQLITE_STATIC);
+
+          if (sqlite3_step(stmt) == SQLITE_ROW) {
+            count = sqlite3_column_int64(stmt, 0);
+          }
+
+          sqlite3_finalize(stmt);
+        }
+
+        return count;
+      })
+      .get();
+}
+
+bool StorageRouter::copyGuild(StorageShard &source, StorageShard &target,
+                              uint64_t guildId) {
+  std::string targetPath = target.dbPath;
+  std::string targetArchivePath = target.archivePath;
+
+  return source.executor
+      ->submit(
+          [guildId, targetPath, targetArchivePath](DatabaseHandler &dbHandler) {
+            sqlite3 *db = dbHandler.getConnection();
+            bool archived = dbHandler.isArchiveAttached();
+
+            // The target starts from a clean slate for the guild, so a copy
+            // repeated after an interrupted move does not duplicate
+            // anything.
+            std::vector<std::string> copyQueries = {
+                "DELETE FROM target.user_orders WHERE user_id >= ?1 AND "
+                "user_id < ?2",
+                "DELETE FROM target.user_transactions WHERE user_id >= ?1 "
+                "AND user_id < ?2",
+                "DELETE FROM target.user_rollups WHERE user_id >= ?1 AND "
+                "user_id < ?2",
+                "DELETE FROM target.user_stocks WHERE user_id >= ?1 AND "
+                "user_id < ?2",
+                "DELETE FROM target.users WHERE user_id >= ?1 AND "
+                "user_id < ?2",
+                "INSERT INTO target.users (user_id, balance) SELECT "
+                "user_id, balance FROM main.users WHERE user_id >= ?1 AND "
+                "user_id < ?2",
+                "INSERT INTO target.user_stocks (user_id, stock_name, "
+                "quantity, avg_cost, realized_pnl) SELECT user_id, "
+                "stock_name, quantity, avg_cost, realized_pnl FROM "
+                "main.user_stocks WHERE user_id >= ?1 AND user_id < ?2"};
+
+            // The target numbers the rows anew, in ledger order. Archived
+            // rows are numbered first, through the target's ledger so the
+            // numbers are never handed out again, and then moved on to its
+            // archive; the hot rows that follow are numbered after them, so
+            // the archive stays older than the ledger.
+            if (archived) {
+              copyQueries.insert(
+                  copyQueries.end(),
+                  {"DELETE FROM targetArchive.user_transactions WHERE "
+                   "user_id >= ?1 AND user_id < ?2",
+                   "INSERT INTO target.user_transactions (user_id, "
+                   "stock_name, quantity, price, timestamp) SELECT user_id, "
+                   "stock_name, quantity, price, timestamp FROM "
+                   "archive.user_transactions WHERE user_id >= ?1 AND "
+                   "user_id < ?2 ORDER BY transaction_id",
+                   "INSERT INTO targetArchive.user_transactions SELECT "
+                   "transaction_id, user_id, stock_name, quantity, price, "
+                   "timestamp FROM target.user_transactions WHERE user_id >= "
+                   "?1 AND user_id < ?2",
+                   "DELETE FROM target.user_transactions WHERE user_id >= ?1 "
+                   "AND user_id < ?2"});
+            }
+
+            copyQueries.insert(
+                copyQueries.end(),
+                {"INSERT INTO target.user_transactions (user_id, stock_name, "
+                 "quantity, price, timestamp) SELECT user_id, stock_name, "
+                 "quantity, price, timestamp FROM main.user_transactions "
+                 "WHERE user_id >= ?1 AND user_id < ?2 ORDER BY "
+                 "transaction_id",
+                 "INSERT INTO target.user_orders (user_id, stock_name, side, "
+                 "order_type, quantity, trigger_price, timestamp) SELECT "
+                 "user_id, stock_name, side, order_type, quantity, "
+                 "trigger_price, timestamp FROM main.user_orders WHERE "
+                 "user_id >= ?1 AND user_id < ?2 ORDER BY order_id"});
+
+            if (!attachDatabase(db, targetPath, "target")) {
+              std::cerr << "Failed to attach target shard." << std::endl;
+              return false;
+            }
+
+            if (archived &&
+                !attachDatabase(db, targetArchivePath, "targetArchive")) {
+              std::cerr << "Failed to attach target archive." << std::endl;
+              sqlite3_exec(db, "DETACH DATABASE target;", nullptr, nullptr,
+                           nullptr);
+              return false;
+            }
+
+            bool success = dbHandler.beginTransaction();
+
+            if (success && runForGuild(db, copyQueries, guildId)) {
+              success = dbHandler.commitTransaction();
+            } else {
+              dbHandler.rollbackTransaction();
+              success = false;
+            }
+
+            if ((archived && sqlite3_exec(db, "DETACH DATABASE targetArchive;",
+                                          nullptr, nullptr,
+                                          nullptr) != SQLITE_OK) ||
+                sqlite3_exec(db, "DETACH DATABASE target;", nullptr, nullptr,
+                             nullptr) != SQLITE_OK) {
+              std::cerr << "Failed to detach target shard: "
+                        << sqlite3_errmsg(db) << std::endl;
+              success = false;
+            }
+
+            return success;
+          },
+          false)
+      .get();
+}
+
+bool StorageRouter::removeGuild(StorageShard &shard, uint64_t guildId) {
+  return shard.executor
+      ->submit([guildId](DatabaseHandler &dbHandler) {
+        std::vector<std::string> deleteQueries = {
+            "DELETE FROM main.user_orders WHERE user_id >= ?1 AND "
+            "user_id < ?2",
+            "DELETE FROM main.user_transactions WHERE user_id >= ?1 "
+            "AND user_id < ?2",
+            "DELETE FROM main.user_rollups WHERE user_id >= ?1 AND "
+            "user_id < ?2",
+            "DELETE FROM main.user_stocks WHERE user_id >= ?1 AND "
+            "user_id < ?2",
+            "DELETE FROM main.users WHERE user_id >= ?1 AND "
+            "user_id < ?2"};
+
+        if (dbHandler.isArchiveAttached()) {
+          deleteQueries.push_back(
+              "DELETE FROM archive.user_transactions WHERE user_id >= "
+              "?1 AND user_id < ?2");
+        }
+
+        return runForGuild(dbHandler.getConnection(), deleteQueries, guildId);
+      })
+      .get();
+}
+
+bool StorageRouter::moveGuild(uint64_t guildId, size_t toIndex) {
+  if (guildId == 0 || toIndex >= shards.size()) {
+    std::cerr << "Cannot move guild " << guildId << " to shard " << toIndex
+              << "." << std::endl;
+    return false;
+  }
+
+  StorageShard &source = getShardForGuild(guildId);
+
+  // The catalog is repointed only once the copy has committed, so a guild
+  // already placed on the target has all its rows there.
+  if (source.index != toIndex &&
+      (!copyGuild(source, *shards[toIndex], guildId) ||
+       !setPlacement(guildId, toIndex))) {
+    std::cerr << "Failed to copy guild " << guildId << " to shard " << toIndex
+              << "." << std::endl;
+    return false;
+  }
+
+  // Clears every other shard rather than just the source, so a rerun after
+  // a move that died before its deletes finishes them.
+  for (const auto &shard : shards) {
+    if (shard->index != toIndex && !removeGuild(*shard, guildId)) {
+      std::cerr << "Moved guild " << guildId << " but failed to remove it "
+                << "from shard " << shard->index << "." << std::endl;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool StorageRouter::splitShard(size_t fromIndex, size_t toIndex) {
+  if (fromIndex >= shards.size() || toIndex >= shards.size() ||
+      fromIndex == toIndex) {
+    std::cerr << "Invalid shards to split." << std::endl;
+    return false;
+  }
+
+  std::vector<std::pair<int64_t, uint64_t>> guilds;
+
+  for (uint64_t guildId : getGuilds(fromIndex)) {
+    guilds.emplace_back(getGuildActivity(*shards[fromIndex], guildId),
+                        guildId);
+  }
+
+  // Alternating down the activity ranking splits the load about evenly.
+  std::sort(guilds.rbegin(), guilds.rend());
+
+  for (size_t i = 1; i < guilds.size(); i += 2) {
+    if (!moveGuild(guilds[i].second, toIndex)) {
+      return false;
+    }
+
+    std::cout << "Moved guild " << guilds[i].second << " to shard " << toIndex
+              << "." << std::endl;
+  }
+
+  return true;
+}
+
+bool StorageRouter::adoptLegacyAccounts(uint64_t guildId) {
+  if (guildId == 0) {
+    std::cerr << "Legacy accounts must be adopted by a guild." << std::endl;
+    return false;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(catalogMutex);
+
+    const char *query = "SELECT guild_id FROM legacy_accounts";
+    sqlite3_stmt *stmt;
+
+    if (sqlite3_prepare_v2(catalog, query, -1, &stmt, nullptr) != SQLITE_OK) {
+      std::cerr << "Failed to prepare statement for reading legacy accounts."
+                << std::endl;
+      return false;
+    }
+
+    bool adopted = sqlite3_step(stmt) == SQLITE_ROW;
+
+    if (adopted) {
+      std::cerr << "Legacy accounts were already adopted by guild "
+                << sqlite3_column_int64(stmt, 0) << "." << std::endl;
+    }
+
+    sqlite3_finalize(stmt);
+
+    if (adopted) {
+      return false;
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(placementsMutex);
+
+    auto it = placements.find(guildId);
+
+    if (it != placements.end() && it->second != 0) {
+      std::cerr << "Guild " << guildId << " is on shard " << it->second
+                << "; move it to shard 0 first." << std::endl;
+      return false;
+    }
+  }
+
+  if (!setPlacement(guildId, 0)) {
+    std::cerr << "Failed to place guild " << guildId << " on shard 0."
+              << std::endl;
+    return false;
+  }
+
+  // Legacy keys are the ones without a guild prefix. ?1 is the guild's
+  // prefix; users is renamed last so the other tables can still check it for
+  // accounts the guild already has.
+  bool renamed =
+      shards[0]
+          ->executor
+          ->submit(
+              [guildId](DatabaseHandler &dbHandler) {
+                std::string legacyRows =
+                    " SET user_id = ?1 || user_id WHERE instr(user_id, ':') "
+                    "= 0 AND ?1 || user_id NOT IN (SELECT user_id FROM "
+                    "main.users)";
+                std::vector<std::string> renameQueries = {
+                    "UPDATE main.user_orders" + legacyRows,
+                    "UPDATE main.user_transactions" + legacyRows,
+                    "UPDATE main.user_rollups" + legacyRows,
+                    "UPDATE main.user_stocks" + legacyRows};
+
+                if (dbHandler.isArchiveAttached()) {
+                  renameQueries.push_back("UPDATE archive.user_transactions" +
+                                          legacyRows);
+                }
+
+                renameQueries.push_back("UPDATE main.users" + legacyRows);
+
+                if (!dbHandler.beginTransaction()) {
+                  return false;
+                }
+
+                if (!runForGuild(dbHandler.getConnection(), renameQueries,
+                                 guildId) ||
+                    !dbHandler.commitTransaction()) {
+                  dbHandler.rollbackTransaction();
+                  return false;
+                }
+
+                return true;
+              },
+              false)
+          .get();
+
+  if (!renamed) {
+    std::cerr << "Failed to hand legacy accounts to guild " << guildId << "."
+              << std::endl;
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(catalogMutex);
+
+  const char *query = "INSERT INTO legacy_accounts (guild_id) VALUES (?)";
+  sqlite3_stmt *stmt;
+
+  if (sqlite3_prepare_v2(catalog, query, -1, &stmt, nullptr) != SQLITE_OK) {
+    std::cerr << "Failed to prepare statement for recording legacy accounts."
+              << std::endl;
+    return false;
+  }
+
+  sqlite3_bind_int64(stmt, 1, static_cast<sqlite3_int64>(guildId));
+
+  int result = sqlite3_step(stmt);
+
+  sqlite3_finalize(stmt);
+
+  return result == SQLITE_DONE;
+}
+
+std::string StorageRouter::getAccountId(uint64_t guildId, uint64_t userId) {
+  if (guildId == 0) {
+    return std::to_string(userId);
+  }
+
+  return std::to_string(guildId) + ":" + std::to_string(userId);
+}
+
+std::string StorageRouter::getShardPath(const std::string &path,
+                                        size_t index) {
+  if (index == 0) {
+    return path;
+  }
+
+  size_t extension = path.rfind('.');
+  size_t directory = path.rfind('/');
+
+  if (extension == std::string::npos ||
+      (directory != std::string::npos && extension < directory)) {
+    return path + "-" + std::to_string(index);
+  }
+
+  return path.substr(0, extension) + "-" + std::to_string(index) +
+         path.substr(extension);
+}
@@ -0,0 +1,168 @@
+#include "../include/symbolDirectory.hpp"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sys/stat.h>
+#include <utility>
+
+namespace {
+
+int64_t modifiedSeconds(const std::filesystem::file_time_type &time) {
+  return std::chrono::duration_cast<std::chrono::seconds>(
+             time.time_since_epoch())
+      .count();
+}
+
+// Identifies one write of the cache file. Every store renames a new file into
+// place, so the inode changes even when the clock has not ticked since the
+// last write.
+bool getCacheVersion(const std::string &path,
+                     std::pair<uint64_t, int64_t> &version) {
+  struct stat st;
+
+  if (stat(path.c_str(), &st) != 0) {
+    return false;
+  }
+
+  version = {static_cast<uint64_t>(st.st_ino),
+             static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 +
+                 st.st_mtim.tv_nsec};
+  return true;
+}
+
+} // namespace
+
+SymbolDirectory::SymbolDirectory(const std::string &cachePath)
+    : cachePath(cachePath),
+      symbols(std::make_shared<const std::vector<std::string>>()) {}
+
+std::shared_ptr<const std::vector<std::string>>
+SymbolDirectory::snapshot() const {
+  return std::atomic_load(&symbols);
+}
+
+void SymbolDirectory::publish(std::vector<std::string> sorted) {
+  std::sort(sorted.begin(), sorted.end());
+  sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+  sorted.shrink_to_fit();
+
+  std::atomic_store(&symbols,
+                    std::shared_ptr<const std::vector<std::string>>(
+                        std::make_shared<std::vector<std::string>>(
+                            std::move(sorted))));
+}
+
+bool SymbolDirectory::reload() {
+  std::lock_guard<std::mutex> lock(reloadMutex);
+
+  std::pair<uint64_t, int64_t> version;
+
+  if (!getCacheVersion(cachePath, version)) {
+    return false;
+  }
+
+  if (version == loadedVersion) {
+    return true;
+  }
+
+  std::ifstream file(cachePath);
+
+  if (!file.is_open()) {
+    std::cerr << "Error opening file: " << cachePath << std::endl;
+    return false;
+  }
+
+  std::vector<std::string> loaded;
+  std::string symbol;
+
+  while (std::getline(file, symbol)) {
+    if (!symbol.empty()) {
+      loaded.push_back(symbol);
+    }
+  }
+
+  if (loaded.empty()) {
+    std::cerr << "Symbol list is empty: " << cachePath << std::endl;
+    return false;
+  }
+
+  publish(std::move(loaded));
+  loadedVersion = version;
+
+  return true;
+}
+
+bool SymbolDirectory::store(std::vector<std::string> fetched) {
+  std::lock_guard<std::mutex> lock(reloadMutex);
+
+  if (fetched.empty()) {
+    return false;
+  }
+
+  publish(std::move(fetched));
+  std::shared_ptr<const std::vector<std::string>> current = snapshot();
+
+  // Other processes reload the file, so it is replaced in one rename.
+  std::string partialPath = cachePath + ".partial";
+  std::ofstream file(partialPath, std::ofstream::trunc);
+
+  for (const std::string &symbol : *current) {
+    file << symbol << '\n';
+  }
+
+  file.close();
+
+  std::error_code ec;
+
+  if (file) {
+    std::filesystem::rename(partialPath, cachePath, ec);
+  }
+
+  if (!file || ec) {
+    std::cerr << "Failed to write symbol list: " << cachePath << std::endl;
+    std::filesystem::remove(partialPath, ec);
+    return false;
+  }
+
+  getCacheVersion(cachePath, loadedVersion);
+
+  return true;
+}
+
+int64_t SymbolDirectory::getCacheAgeSeconds() const {
+  std::error_code ec;
+  std::filesystem::file_time_type modified =
+      std::filesystem::last_write_time(cachePath, ec);
+
+  if (ec) {
+    return -1;
+  }
+
+  return modifiedSeconds(std::filesystem::file_time_type::clock::now()) -
+         modifiedSeconds(modified);
+}
+
+bool SymbolDirectory::isLoaded() const { return !snapshot()->empty(); }
+
+bool SymbolDirectory::contains(const std::string &symbol) const {
+  std::shared_ptr<const std::vector<std::string>> current = snapshot();
+
+  return std::binary_search(current->begin(), current->end(), symbol);
+}
+
+std::vector<std::string> SymbolDirectory::complete(const std::string &prefix,
+                                                   size_t limit) const {
+  std::shared_ptr<const std::vector<std::string>> current = snapshot();
+  std::vector<std::string> matches;
+
+  for (auto it = std::lower_bound(current->begin(), current->end(), prefix);
+       it != current->end() && matches.size() < limit &&
+       it->compare(0, prefix.size(), prefix) == 0;
+       ++it) {
+    matches.push_back(*it);
+  }
+
+  return matches;
+}
@@ -0,0 +1,511 @@
+#include "../include/tickStore.hpp"
+#include <algorithm>
+#include <ctime>
+#include <fcntl.h>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const int64_t minuteMillis = static_cast<int64_t>(BarInterval::OneMinute);
+const int64_t dayMillis = static_cast<int64_t>(BarInterval::OneDay);
+
+int64_t floorDiv(int64_t value, int64_t divisor) {
+  int64_t quotient = value / divisor;
+  return (value % divisor < 0) ? quotient - 1 : quotient;
+}
+
+std::string dayToName(int64_t day) {
+  std::time_t time = static_cast<std::time_t>(day * 86400);
+  std::tm tm{};
+  gmtime_r(&time, &tm);
+
+  std::stringstream ss;
+  ss << std::put_time(&tm, "%Y%m%d");
+
+  return ss.str();
+}
+
+bool nameToDay(const std::string &name, int64_t &day) {
+  std::tm tm{};
+  std::istringstream ss(name);
+  ss >> std::get_time(&tm, "%Y%m%d");
+
+  if (ss.fail()) {
+    return false;
+  }
+
+  day = floorDiv(static_cast<int64_t>(timegm(&tm)), 86400);
+  return true;
+}
+
+bool isValidSymbol(const std::string &symbol) {
+  return !symbol.empty() && symbol[0] != '.' &&
+         symbol.find('/') == std::string::npos;
+}
+
+// Read-only memory mapping of a whole segment file.
+class MappedFile {
+private:
+  int fd = -1;
+  void *data = nullptr;
+  size_t size = 0;
+
+public:
+  MappedFile(const std::string &path) {
+    fd = open(path.c_str(), O_RDONLY);
+
+    if (fd < 0) {
+      return;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+      void *mapped = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ,
+                          MAP_PRIVATE, fd, 0);
+
+      if (mapped != MAP_FAILED) {
+        data = mapped;
+        size = static_cast<size_t>(st.st_size);
+      }
+    }
+  }
+
+  ~MappedFile() {
+    if (data) {
+      munmap(data, size);
+    }
+
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  template <typename T> const T *as() const {
+    return static_cast<const T *>(data);
+  }
+
+  template <typename T> size_t count() const { return size / sizeof(T); }
+};
+
+} // namespace
+
+TickStore::TickStore(const std::string &rootPath) : rootPath(rootPath) {
+  std::error_code ec;
+  std::filesystem::create_directories(rootPath, ec);
+
+  if (ec) {
+    std::cerr << "Failed to create tick store directory." << std::endl;
+  }
+}
+
+std::string TickStore::segmentPath(const std::string &symbol, int64_t day,
+                                   const std::string &extension) {
+  return rootPath + "/" + symbol + "/" + dayToName(day) + extension;
+}
+
+TickStore::~TickStore() {
+  for (auto &segment : openSegments) {
+    closeSegment(segment.second);
+  }
+}
+
+void TickStore::closeSegment(OpenSegment &segment) {
+  if (segment.timestampFd >= 0) {
+    close(segment.timestampFd);
+  }
+
+  if (segment.priceFd >= 0) {
+    close(segment.priceFd);
+  }
+
+  segment.day = -1;
+  segment.timestampFd = -1;
+  segment.priceFd = -1;
+}
+
+// A writer that died between its two writes leaves one column a tick longer
+// than the other, which would pair every later price with the wrong time.
+// Both are cut back to the ticks they have in common. Called with the
+// segment's flock held.
+bool TickStore::alignColumns(OpenSegment &segment) {
+  struct stat timestampStat;
+  struct stat priceStat;
+
+  if (fstat(segment.timestampFd, &timestampStat) != 0 ||
+      fstat(segment.priceFd, &priceStat) != 0) {
+    return false;
+  }
+
+  off_t length = std::min(
+      timestampStat.st_size / static_cast<off_t>(sizeof(int64_t)),
+      priceStat.st_size / static_cast<off_t>(sizeof(double)));
+
+  if (timestampStat.st_size != length * static_cast<off_t>(sizeof(int64_t)) &&
+      ftruncate(segment.timestampFd,
+                length * static_cast<off_t>(sizeof(int64_t))) != 0) {
+    return false;
+  }
+
+  if (priceStat.st_size != length * static_cast<off_t>(sizeof(double)) &&
+      ftruncate(segment.priceFd, length * static_cast<off_t>(sizeof(double))) !=
+          0) {
+    return false;
+  }
+
+  return true;
+}
+
+bool TickStore::appendTick(const std::string &symbol, int64_t timestamp,
+                           double price) {
+  if (!isValidSymbol(symbol)) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(appendMutex);
+
+  auto segmentIt = openSegments.find(symbol);
+
+  if (segmentIt == openSegments.end()) {
+    if (openSegments.size() >= TICK_OPEN_SEGMENTS_MAX) {
+      auto evicted = openSegments.find(recentSymbols.back());
+      closeSegment(evicted->second);
+      openSegments.erase(evicted);
+      recentSymbols.pop_back();
+    }
+
+    recentSymbols.push_front(symbol);
+    segmentIt = openSegments.emplace(symbol, OpenSegment()).first;
+    segmentIt->second.recent = recentSymbols.begin();
+  } else {
+    recentSymbols.splice(recentSymbols.begin(), recentSymbols,
+                         segmentIt->second.recent);
+  }
+
+  OpenSegment &segment = segmentIt->second;
+
+  // Segments are binary searched on read, so keep timestamps monotonic.
+  timestamp = std::max(timestamp, segment.lastTimestamp);
+
+  int64_t day = floorDiv(timestamp, dayMillis);
+
+  if (segment.day != day) {
+    closeSegment(segment);
+
+    std::error_code ec;
+    std::filesystem::create_directories(rootPath + "/" + symbol, ec);
+
+    segment.day = day;
+    segment.timestampFd = open(segmentPath(symbol, day, ".ts").c_str(),
+                               O_RDWR | O_CREAT | O_APPEND, 0644);
+    segment.priceFd = open(segmentPath(symbol, day, ".px").c_str(),
+                           O_RDWR | O_CREAT | O_APPEND, 0644);
+
+    if (segment.timestampFd < 0 || segment.priceFd < 0) {
+      std::cerr << "Failed to open tick segment for " << symbol << "."
+                << std::endl;
+      closeSegment(segment);
+      return false;
+    }
+  }
+
+  // The two columns must stay the same length even with several writers.
+  flock(segment.timestampFd, LOCK_EX);
+
+  if (!alignColumns(segment)) {
+    flock(segment.timestampFd, LOCK_UN);
+    std::cerr << "Failed to align tick segment for " << symbol << "."
+              << std::endl;
+    closeSegment(segment);
+    return false;
+  }
+
+  // Other processes append to the same segment, so the order to keep is the
+  // file's, not just this process's.
+  struct stat st;
+  int64_t lastTimestamp;
+
+  if (fstat(segment.timestampFd, &st) == 0 &&
+      st.st_size >= static_cast<off_t>(sizeof(lastTimestamp)) &&
+      pread(segment.timestampFd, &lastTimestamp, sizeof(lastTimestamp),
+            st.st_size - static_cast<off_t>(sizeof(lastTimestamp))) ==
+          static_cast<ssize_t>(sizeof(lastTimestamp))) {
+    timestamp = std::max(timestamp, lastTimestamp);
+  }
+
+  bool success = write(segment.timestampFd, &timestamp, sizeof(timestamp)) ==
+                     static_cast<ssize_t>(sizeof(timestamp)) &&
+                 write(segment.priceFd, &price, sizeof(price)) ==
+                     static_cast<ssize_t>(sizeof(price));
+
+  flock(segment.timestampFd, LOCK_UN);
+
+  if (success) {
+    segment.lastTimestamp = timestamp;
+  } else {
+    std::cerr << "Failed to append tick for " << symbol << "." << std::endl;
+    closeSegment(segment);
+  }
+
+  return success;
+}
+
+template <typename Callback>
+void TickStore::forEachBar(const std::string &symbol, int64_t from, int64_t to,
+                           Callback &&callback) {
+  if (from >= to || !isValidSymbol(symbol)) {
+    return;
+  }
+
+  int64_t firstDay = floorDiv(from, dayMillis);
+  int64_t lastDay = floorDiv(to - 1, dayMillis);
+
+  for (int64_t day = firstDay; day <= lastDay; day++) {
+    MappedFile barFile(segmentPath(symbol, day, ".bar"));
+    const Bar *bars = barFile.as<Bar>();
+    size_t barCount = barFile.count<Bar>();
+    // Raw ticks before the end of the last bar were compacted into it; the
+    // raw files are only removed after the bars are in place.
+    int64_t compactedUntil = INT64_MIN;
+
+    if (bars && barCount > 0) {
+      compactedUntil = bars[barCount - 1].timestamp + minuteMillis;
+
+      // Include the minute bar that contains `from`.
+      const Bar *bar = std::lower_bound(
+          bars, bars + barCount, from, [](const Bar &bar, int64_t value) {
+            return bar.timestamp + minuteMillis <= value;
+          });
+
+      for (; bar != bars + barCount && bar->timestamp < to; bar++) {
+        callback(*bar);
+      }
+    }
+
+    MappedFile timestampFile(segmentPath(symbol, day, ".ts"));
+    MappedFile priceFile(segmentPath(symbol, day, ".px"));
+    const int64_t *timestamps = timestampFile.as<int64_t>();
+    const double *prices = priceFile.as<double>();
+
+    if (!timestamps || !prices) {
+      continue;
+    }
+
+    size_t tickCount =
+        std::min(timestampFile.count<int64_t>(), priceFile.count<double>());
+
+    size_t index = std::lower_bound(timestamps, timestamps + tickCount,
+                                    std::max(from, compactedUntil)) -
+                   timestamps;
+
+    for (; index < tickCount && timestamps[index] < to; index++) {
+      double price = prices[index];
+      callback(Bar{timestamps[index], price, price, price, price});
+    }
+  }
+}
+
+std::vector<Tick> TickStore::getTicks(const std::string &symbol, int64_t from,
+                                      int64_t to) {
+  std::vector<Tick> ticks;
+
+  forEachBar(symbol, from, to, [&ticks](const Bar &bar) {
+    ticks.push_back(Tick{bar.timestamp, bar.close});
+  });
+
+  return ticks;
+}
+
+std::vector<Bar> TickStore::getBars(const std::string &symbol, int64_t from,
+                                    int64_t to, BarInterval interval) {
+  std::vector<Bar> bars;
+  int64_t width = static_cast<int64_t>(interval);
+
+  forEachBar(symbol, from, to, [&bars, width](const Bar &bar) {
+    int64_t bucket = floorDiv(bar.timestamp, width) * width;
+
+    if (bars.empty() || bars.back().timestamp != bucket) {
+      bars.push_back(Bar{bucket, bar.open, bar.high, bar.low, bar.close});
+      return;
+    }
+
+    Bar &current = bars.back();
+    current.high = std::max(current.high, bar.high);
+    current.low = std::min(current.low, bar.low);
+    current.close = bar.close;
+  });
+
+  return bars;
+}
+
+bool TickStore::compactSegment(const std::string &symbol, int64_t day) {
+  {
+    std::lock_guard<std::mutex> lock(appendMutex);
+
+    auto segmentIt = openSegments.find(symbol);
+    if (segmentIt != openSegments.end() && segmentIt->second.day == day) {
+      closeSegment(segmentIt->second);
+    }
+  }
+
+  std::string timestampPath = segmentPath(symbol, day, ".ts");
+  std::string pricePath = segmentPath(symbol, day, ".px");
+
+  std::vector<Bar> bars;
+  {
+    MappedFile timestampFile(timestampPath);
+    MappedFile priceFile(pricePath);
+    const int64_t *timestamps = timestampFile.as<int64_t>();
+    const double *prices = priceFile.as<double>();
+    size_t tickCount =
+        std::min(timestampFile.count<int64_t>(), priceFile.count<double>());
+    for (size_t i = 0; timestamps && prices && i < tickCount; i++) {
+      int64_t bucket = floorDiv(timestamps[i], minuteMillis) * minuteMillis;
+      double price = prices[i];
+
+      if (bars.empty() || bars.back().timestamp != bucket) {
+        bars.push_back(Bar{bucket, price, price, price, price});
+      } else {
+        Bar &current = bars.back();
+        current.high = std::max(current.high, price);
+        current.low = std::min(current.low, price);
+        current.close = price;
+      }
+    }
+  }
+
+  std::string barPath = segmentPath(symbol, day, ".bar");
+
+  // A crash after the bars were written but before the raw segment was
+  // removed leaves both; bars already covering these ticks are replaced
+  // rather than appended to.
+  {
+    MappedFile barFile(barPath);
+    const Bar *existing = barFile.as<Bar>();
+    size_t existingCount = barFile.count<Bar>();
+    int64_t firstBucket = bars.empty() ? INT64_MAX : bars.front().timestamp;
+    size_t kept = 0;
+
+    while (existing && kept < existingCount &&
+           existing[kept].timestamp < firstBucket) {
+      kept++;
+    }
+
+    bars.insert(bars.begin(), existing, existing + kept);
+  }
+
+  // Written beside the old file and renamed over it, so the .bar file is
+  // always either the old bars or all of the new ones.
+  std::string partialPath = barPath + ".partial";
+  int barFd = open(partialPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+  if (barFd < 0) {
+    std::cerr << "Failed to open bar segment for " << symbol << "."
+              << std::endl;
+    return false;
+  }
+
+  ssize_t size = static_cast<ssize_t>(bars.size() * sizeof(Bar));
+  bool success = write(barFd, bars.data(), static_cast<size_t>(size)) == size &&
+                 fsync(barFd) == 0;
+
+  close(barFd);
+
+  std::error_code ec;
+
+  if (success) {
+    std::filesystem::rename(partialPath, barPath, ec);
+    success = !ec;
+  }
+
+  if (!success) {
+    std::cerr << "Failed to write bar segment for " << symbol << "."
+              << std::endl;
+    std::filesystem::remove(partialPath, ec);
+    return false;
+  }
+
+  std::filesystem::remove(timestampPath, ec);
+  std::filesystem::remove(pricePath, ec);
+
+  return true;
+}
+
+bool TickStore::compactSegments(int64_t before) {
+  int64_t beforeDay = floorDiv(before, dayMillis);
+  bool success = true;
+  std::error_code ec;
+
+  for (const auto &symbolDir :
+       std::filesystem::directory_iterator(rootPath, ec)) {
+    if (!symbolDir.is_directory()) {
+      continue;
+    }
+
+    std::string symbol = symbolDir.path().filename().string();
+    std::vector<int64_t> days;
+
+    for (const auto &segment :
+         std::filesystem::directory_iterator(symbolDir.path(), ec)) {
+      int64_t day;
+
+      if (segment.path().extension() == ".ts" &&
+          nameToDay(segment.path().stem().string(), day) && day < beforeDay) {
+        days.push_back(day);
+      }
+    }
+
+    for (int64_t day : days) {
+      success = compactSegment(symbol, day) && success;
+    }
+  }
+
+  return success;
+}
+
+bool TickStore::removeSegments(int64_t before) {
+  int64_t beforeDay = floorDiv(before, dayMillis);
+  bool success = true;
+  std::error_code ec;
+
+  for (const auto &symbolDir :
+       std::filesystem::directory_iterator(rootPath, ec)) {
+    if (!symbolDir.is_directory()) {
+      continue;
+    }
+
+    std::vector<std::filesystem::path> expired;
+
+    for (const auto &segment :
+         std::filesystem::directory_iterator(symbolDir.path(), ec)) {
+      int64_t day;
+
+      if (nameToDay(segment.path().stem().string(), day) && day < beforeDay) {
+        expired.push_back(segment.path());
+      }
+    }
+
+    for (const auto &path : expired) {
+      if (!std::filesystem::remove(path, ec)) {
+        std::cerr << "Failed to remove tick segment " << path << "."
+                  << std::endl;
+        success = false;
+      }
+    }
+
+    if (std::filesystem::is_empty(symbolDir.path(), ec)) {
+      std::filesystem::remove(symbolDir.path(), ec);
+    }
+  }
+
+  return success;
+}
@@ -0,0 +1,256 @@
+#include "../include/tracer.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <set>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+// One thread's spans. Only the owning thread writes; the exporter reads the
+// slots behind `head` and drops any the writer may have lapped meanwhile.
+struct TraceRing {
+  struct Slot {
+    std::atomic<const char *> name{nullptr};
+    std::atomic<int64_t> start{0};
+    std::atomic<int64_t> duration{0};
+    std::atomic<uint64_t> traceId{0};
+  };
+
+  std::unique_ptr<Slot[]> slots{new Slot[TRACE_RING_EVENTS]};
+  std::atomic<uint64_t> head{0};
+  int threadId = 0;
+  std::string threadName;
+};
+
+struct TraceEvent {
+  const char *name;
+  int64_t start;
+  int64_t duration;
+  uint64_t traceId;
+  int threadId;
+};
+
+std::atomic<double> sampleRate{TRACE_SAMPLE_RATE};
+std::atomic<uint64_t> nextTraceId{1};
+
+std::mutex registryMutex;
+std::vector<std::shared_ptr<TraceRing>> rings;
+// Interaction names, kept for the life of the process so spans can point at
+// them.
+std::set<std::string> names;
+
+thread_local uint64_t threadTraceId = 0;
+thread_local std::shared_ptr<TraceRing> threadRing;
+
+TraceRing &getThreadRing() {
+  if (!threadRing) {
+    threadRing = std::make_shared<TraceRing>();
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    threadRing->threadId = static_cast<int>(rings.size()) + 1;
+    rings.push_back(threadRing);
+  }
+
+  return *threadRing;
+}
+
+std::string escapeJson(const std::string &text) {
+  std::string escaped;
+
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+    }
+
+    if (static_cast<unsigned char>(c) >= 0x20) {
+      escaped += c;
+    }
+  }
+
+  return escaped;
+}
+
+const char *internName(const std::string &name) {
+  std::lock_guard<std::mutex> lock(registryMutex);
+
+  return names.insert(name).first->c_str();
+}
+
+} // namespace
+
+void setTraceSampleRate(double rate) { sampleRate.store(rate); }
+
+void setTraceThreadName(const std::string &name) {
+  TraceRing &ring = getThreadRing();
+
+  std::lock_guard<std::mutex> lock(registryMutex);
+  ring.threadName = name;
+}
+
+int64_t traceNow() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+uint64_t currentTraceId() { return threadTraceId; }
+
+void recordSpan(const char *name, int64_t startNanos, int64_t endNanos) {
+  if (threadTraceId == 0) {
+    return;
+  }
+
+  TraceRing &ring = getThreadRing();
+  uint64_t index = ring.head.load(std::memory_order_relaxed);
+  TraceRing::Slot &slot = ring.slots[index % TRACE_RING_EVENTS];
+
+  slot.name.store(name, std::memory_order_relaxed);
+  slot.start.store(startNanos, std::memory_order_relaxed);
+  slot.duration.store(endNanos - startNanos, std::memory_order_relaxed);
+  slot.traceId.store(threadTraceId, std::memory_order_relaxed);
+  ring.head.store(index + 1, std::memory_order_release);
+}
+
+bool writeChromeTrace(const std::string &path) {
+  std::vector<std::shared_ptr<TraceRing>> snapshot;
+  std::vector<std::pair<int, std::string>> threadNames;
+
+  {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    snapshot = rings;
+
+    for (const std::shared_ptr<TraceRing> &ring : rings) {
+      if (!ring->threadName.empty()) {
+        threadNames.emplace_back(ring->threadId, ring->threadName);
+      }
+    }
+  }
+
+  std::vector<TraceEvent> events;
+
+  for (const std::shared_ptr<TraceRing> &ring : snapshot) {
+    uint64_t head = ring->head.load(std::memory_order_acquire);
+    uint64_t oldest = head > TRACE_RING_EVENTS ? head - TRACE_RING_EVENTS : 0;
+    size_t copied = events.size();
+
+    for (uint64_t i = oldest; i < head; i++) {
+      const TraceRing::Slot &slot = ring->slots[i % TRACE_RING_EVENTS];
+      events.push_back(TraceEvent{slot.name.load(std::memory_order_relaxed),
+                                  slot.start.load(std::memory_order_relaxed),
+                                  slot.duration.load(std::memory_order_relaxed),
+                                  slot.traceId.load(std::memory_order_relaxed),
+                                  ring->threadId});
+    }
+
+    // The writer may have reused the oldest slots while they were copied;
+    // only those past the ring's new head minus its size are intact.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t latest = ring->head.load(std::memory_order_relaxed);
+    uint64_t overwritten =
+        latest >= TRACE_RING_EVENTS ? latest - TRACE_RING_EVENTS + 1 : 0;
+
+    if (overwritten > oldest) {
+      size_t lost = static_cast<size_t>(
+          std::min<uint64_t>(overwritten - oldest, head - oldest));
+      events.erase(events.begin() + copied, events.begin() + copied + lost);
+    }
+  }
+
+  int pid = static_cast<int>(getpid());
+
+  std::string partialPath = path + ".partial";
+  std::ofstream file(partialPath, std::ofstream::trunc);
+  file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+  bool first = true;
+
+  for (const std::pair<int, std::string> &threadName : threadNames) {
+    file << (first ? "" : ",") << "{\"name\":\"thread_name\",\"ph\":\"M\","
+         << "\"pid\":" << pid << ",\"tid\":" << threadName.first
+         << ",\"args\":{\"name\":\"" << escapeJson(threadName.second)
+         << "\"}}";
+    first = false;
+  }
+
+  // Timestamps are in microseconds, kept to the nanosecond.
+  file << std::fixed << std::setprecision(3);
+
+  for (const TraceEvent &event : events) {
+    file << (first ? "" : ",") << "{\"name\":\""
+         << escapeJson(event.name ? event.name : "")
+         << "\",\"ph\":\"X\",\"ts\":" << event.start / 1000.0
+         << ",\"dur\":" << event.duration / 1000.0 << ",\"pid\":" << pid
+         << ",\"tid\":" << event.threadId << ",\"args\":{\"trace\":"
+         << event.traceId << "}}";
+    first = false;
+  }
+
+  file << "]}";
+  file.close();
+
+  std::error_code ec;
+
+  if (file) {
+    std::filesystem::rename(partialPath, path, ec);
+  }
+
+  if (!file || ec) {
+    std::cerr << "Failed to write trace: " << path << std::endl;
+    std::filesystem::remove(partialPath, ec);
+    return false;
+  }
+
+  return true;
+}
+
+TraceSpan::TraceSpan(const char *name) : name(name) {
+  if (threadTraceId != 0) {
+    start = traceNow();
+  }
+}
+
+TraceSpan::~TraceSpan() {
+  if (threadTraceId != 0 && start != 0) {
+    recordSpan(name, start, traceNow());
+  }
+}
+
+TraceContext::TraceContext(uint64_t traceId) : previous(threadTraceId) {
+  threadTraceId = traceId;
+}
+
+TraceContext::~TraceContext() { threadTraceId = previous; }
+
+TraceInteraction::TraceInteraction(const std::string &name)
+    : previous(threadTraceId) {
+  thread_local std::mt19937 generator(std::random_device{}());
+  double rate = sampleRate.load(std::memory_order_relaxed);
+
+  if (rate <= 0.0 ||
+      std::uniform_real_distribution<double>(0.0, 1.0)(generator) >= rate) {
+    threadTraceId = 0;
+    return;
+  }
+
+  traceId = nextTraceId.fetch_add(1);
+  this->name = internName(name);
+  threadTraceId = traceId;
+  start = traceNow();
+}
+
+TraceInteraction::~TraceInteraction() {
+  if (traceId != 0) {
+    recordSpan(name, start, traceNow());
+  }
+
+  threadTraceId = previous;
+}
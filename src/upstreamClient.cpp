@@ -0,0 +1,305 @@
+#include "../include/upstreamClient.hpp"
+#include "../include/tracer.hpp"
+#include <algorithm>
+#include <chrono>
+#include <curl/curl.h>
+#include <curl/easy.h>
+#include <curl/multi.h>
+#include <iostream>
+#include <random>
+#include <thread>
+
+namespace {
+
+int64_t steadyMillis() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+size_t appendBody(void *contents, size_t size, size_t nmemb,
+                  std::string *output) {
+  size_t totalSize = size * nmemb;
+  output->append((char *)contents, totalSize);
+  return totalSize;
+}
+
+CURL *startRequest(CURLM *multi, const std::string &url, std::string &body,
+                   int64_t timeoutMillis) {
+  CURL *curl = curl_easy_init();
+
+  if (!curl) {
+    return nullptr;
+  }
+
+  // curl takes 0 to mean no timeout at all.
+  long timeout = std::max<long>(static_cast<long>(timeoutMillis), 1);
+
+  curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, appendBody);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &body);
+  curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS,
+                   std::min<long>(UPSTREAM_CONNECT_TIMEOUT_MILLIS, timeout));
+  curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, timeout);
+
+  curl_multi_add_handle(multi, curl);
+
+  return curl;
+}
+
+} // namespace
+
+UpstreamClient::UpstreamClient() {
+  latencies.reserve(UPSTREAM_LATENCY_SAMPLES);
+}
+
+bool UpstreamClient::allowRequest() {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  if (openUntil == 0) {
+    return true;
+  }
+
+  if (steadyMillis() < openUntil || probing) {
+    return false;
+  }
+
+  probing = true;
+  return true;
+}
+
+void UpstreamClient::recordSuccess(int64_t latencyMillis) {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  consecutiveFailures = 0;
+  openUntil = 0;
+  probing = false;
+
+  if (latencies.size() < UPSTREAM_LATENCY_SAMPLES) {
+    latencies.push_back(latencyMillis);
+  } else {
+    latencies[nextLatency] = latencyMillis;
+    nextLatency = (nextLatency + 1) % UPSTREAM_LATENCY_SAMPLES;
+  }
+}
+
+void UpstreamClient::recordAnswer() {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  consecutiveFailures = 0;
+  openUntil = 0;
+  probing = false;
+}
+
+void UpstreamClient::recordFailure() {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  consecutiveFailures++;
+
+  if (probing || consecutiveFailures >= UPSTREAM_BREAKER_FAILURES) {
+    if (openUntil == 0) {
+      std::cerr << "Upstream unhealthy; failing fast for "
+                << UPSTREAM_BREAKER_COOLDOWN_MILLIS << " ms." << std::endl;
+    }
+
+    openUntil = steadyMillis() + UPSTREAM_BREAKER_COOLDOWN_MILLIS;
+    probing = false;
+  }
+}
+
+int64_t UpstreamClient::getHedgeDelayMillis() {
+  std::vector<int64_t> samples;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (latencies.size() < UPSTREAM_HEDGE_MIN_SAMPLES) {
+      return UPSTREAM_HEDGE_DEFAULT_MILLIS;
+    }
+
+    samples = latencies;
+  }
+
+  auto p95 = samples.begin() + samples.size() * 95 / 100;
+  std::nth_element(samples.begin(), p95, samples.end());
+
+  return std::max<int64_t>(*p95, UPSTREAM_HEDGE_MIN_MILLIS);
+}
+
+bool UpstreamClient::attempt(const std::string &url, int64_t deadline,
+                             std::string &body, bool &retryable) {
+  TRACE_SCOPE("http.attempt");
+
+  CURLM *multi = curl_multi_init();
+
+  if (!multi) {
+    return false;
+  }
+
+  int64_t start = steadyMillis();
+
+  // A backoff that overslept may leave nothing of the deadline.
+  if (deadline - start <= 0) {
+    curl_multi_cleanup(multi);
+    return false;
+  }
+
+  int64_t hedgeAt = start + getHedgeDelayMillis();
+  int64_t timeout =
+      std::min<int64_t>(UPSTREAM_REQUEST_TIMEOUT_MILLIS, deadline - start);
+
+  // The hedge is started at most once, into the second slot.
+  std::string bodies[2];
+  CURL *handles[2] = {startRequest(multi, url, bodies[0], timeout), nullptr};
+  int started = handles[0] ? 1 : 0;
+  int finished = 0;
+  int winner = -1;
+  long lastStatus = 0;
+  CURLcode lastResult = CURLE_OK;
+
+  while (winner < 0 && finished < started) {
+    int running;
+    curl_multi_perform(multi, &running);
+
+    CURLMsg *message;
+    int queued;
+
+    while ((message = curl_multi_info_read(multi, &queued))) {
+      if (message->msg != CURLMSG_DONE) {
+        continue;
+      }
+
+      int index = (message->easy_handle == handles[0]) ? 0 : 1;
+      long status = 0;
+      curl_easy_getinfo(message->easy_handle, CURLINFO_RESPONSE_CODE, &status);
+      finished++;
+
+      if (message->data.result == CURLE_OK && status == 200) {
+        if (winner < 0) {
+          winner = index;
+        }
+      } else {
+        lastStatus = status;
+        lastResult = message->data.result;
+      }
+    }
+
+    if (winner >= 0 || finished == started) {
+      break;
+    }
+
+    int64_t now = steadyMillis();
+
+    if (!handles[1] && now >= hedgeAt && deadline - now > 0) {
+      handles[1] =
+          startRequest(multi, url, bodies[1],
+                       std::min<int64_t>(UPSTREAM_REQUEST_TIMEOUT_MILLIS,
+                                         deadline - now));
+
+      if (handles[1]) {
+        started++;
+        hedges++;
+      }
+
+      continue;
+    }
+
+    int waitMillis = handles[1] ? 100 : static_cast<int>(hedgeAt - now);
+    curl_multi_poll(multi, nullptr, 0, std::max(waitMillis, 1), nullptr);
+  }
+
+  for (CURL *handle : handles) {
+    if (handle) {
+      curl_multi_remove_handle(multi, handle);
+      curl_easy_cleanup(handle);
+    }
+  }
+
+  curl_multi_cleanup(multi);
+
+  if (winner < 0) {
+    // Rate limits and server errors may pass; other client errors will not.
+    retryable = lastStatus == 0 || lastStatus == 429 || lastStatus >= 500;
+
+    std::cerr << "Failed to retrieve data: "
+              << (lastStatus != 0 ? "HTTP " + std::to_string(lastStatus)
+                                  : std::string(curl_easy_strerror(lastResult)))
+              << std::endl;
+    return false;
+  }
+
+  if (winner == 1) {
+    hedgeWins++;
+  }
+
+  body = std::move(bodies[winner]);
+  recordSuccess(steadyMillis() - start);
+
+  return true;
+}
+
+bool UpstreamClient::get(const std::string &url, std::string &body) {
+  requests++;
+
+  if (!allowRequest()) {
+    rejected++;
+    return false;
+  }
+
+  thread_local std::mt19937 jitter(std::random_device{}());
+  int64_t deadline = steadyMillis() + UPSTREAM_DEADLINE_MILLIS;
+  bool retryable = true;
+
+  for (int i = 0; i < UPSTREAM_MAX_ATTEMPTS; i++) {
+    retryable = true;
+
+    if (attempt(url, deadline, body, retryable)) {
+      return true;
+    }
+
+    if (!retryable || i + 1 == UPSTREAM_MAX_ATTEMPTS) {
+      break;
+    }
+
+    // Full jitter: a uniform wait up to the exponential backoff, so clients
+    // that failed together do not retry together.
+    int64_t backoff = std::uniform_int_distribution<int64_t>(
+        0, UPSTREAM_BACKOFF_BASE_MILLIS << i)(jitter);
+
+    if (steadyMillis() + backoff >= deadline) {
+      break;
+    }
+
+    retries++;
+    TRACE_SCOPE("http.backoff");
+    std::this_thread::sleep_for(std::chrono::milliseconds(backoff));
+  }
+
+  // The breaker counts failed calls, not attempts. A client error means the
+  // upstream answered, so it counts as a sign of health instead.
+  if (retryable) {
+    recordFailure();
+  } else {
+    recordAnswer();
+  }
+
+  return false;
+}
+
+bool UpstreamClient::isOpen() {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  return openUntil != 0;
+}
+
+UpstreamStats UpstreamClient::getStats() const {
+  UpstreamStats stats;
+  stats.requests = requests.load();
+  stats.retries = retries.load();
+  stats.hedges = hedges.load();
+  stats.hedgeWins = hedgeWins.load();
+  stats.rejected = rejected.load();
+
+  return stats;
+}